@@ -2,6 +2,7 @@
 
 #include "HX711_ADC.h"
 #include "Servo.h"
+#include "wt_core.h" // binary wire protocol and firmware core shared with the C++ program
 
 // Define the pins for HX711 module
 const int LOADCELL_DOUT_PIN_V = 2; // Vertical HX711 DOUT pin connected to Arduino pin 2
@@ -14,27 +15,35 @@ const int SERVO_PIN = 6;         // Servo pin is controlled to pin 6
 const int BASE_ANGLE = 85;
 int angle = BASE_ANGLE;
 
-// MISC VARIABLES FOR LOAD CELLS
-static float weight_v = 0.0f;
-static float weight_h = 0.0f;
-static String buffer;
-
 // Create an HX711 for each load cell and a Servo object
 HX711_ADC lc_v(LOADCELL_DOUT_PIN_V, LOADCELL_SCK_PIN_V);
 HX711_ADC lc_h(LOADCELL_DOUT_PIN_H, LOADCELL_SCK_PIN_H);
 Servo servo;
 
-// calibration vertical: 362, 382
-// calibration horizontal: 4, 6, 26.5
+// Protocol and command state machine, shared with the host-side simulator (fixed buffers, no heap allocation)
+static WtCore core;
 
-static float calibration_v = 712; // REPLACE WITH YOUR CALIBRATED VALUE 
-static float calibration_h = 26.5; // REPLACE WITH YOUR CALIBRATED VALUE 
+// Hooks called by the core (see wt_core.h)
+void writeBytes(void*, const uint8_t* data, uint16_t length) {
+  Serial.write(data, length);
+}
 
-unsigned long t = 0;
+uint16_t writableBytes(void*) {
+  return Serial.availableForWrite(); // Serial.write() would block the loop once the 64 byte TX buffer is full
+}
+
+void setAngle(void*, int16_t value) {
+  angle = value;
+  servo.write(angle);
+}
+
+void setBaud(void*, uint32_t baud) {
+  Serial.flush(); // the acknowledgement still goes out at the old rate
+  Serial.begin(baud);
+}
 
 void setup() {
-  Serial.begin(115200); delay(10); // Start serial communication for debugging
-  Serial.setTimeout(5); // Set a shorter timeout to avoid random 1s timeout 
+  Serial.begin(WT_BASE_BAUD); delay(10); // Start serial communication for debugging
 
   // Servo connection
   servo.attach(SERVO_PIN);
@@ -48,59 +57,33 @@ void setup() {
   byte lc_v_rdy = 0;
   byte lc_h_rdy = 0;
 
-  while ((lc_v_rdy + lc_h_rdy) < 2) { //run startup, stabilization and tare, both modules simultaniously
-    if (!lc_v_rdy) lc_v_rdy = lc_v.startMultiple(stabilizingtime, true);
-    if (!lc_h_rdy) lc_h_rdy = lc_h.startMultiple(stabilizingtime, true);
+  while ((lc_v_rdy + lc_h_rdy) < 2) { //run startup and stabilization, both modules simultaniously (the host tares)
+    if (!lc_v_rdy) lc_v_rdy = lc_v.startMultiple(stabilizingtime, false);
+    if (!lc_h_rdy) lc_h_rdy = lc_h.startMultiple(stabilizingtime, false);
   }
 
-  lc_v.setCalFactor(calibration_v); // user set calibration value (float)
-  lc_h.setCalFactor(calibration_h); // user set calibration value (float)
-}
+  // getData() returns raw counts: the calibration (offset, gain, cross-talk) is applied on the host
+  lc_v.setCalFactor(1.0f);
+  lc_h.setCalFactor(1.0f);
 
-void serialFlush(){
-  while(Serial.available() > 0) {
-    char t = Serial.read();
-  }
+  WtCoreHooks hooks = {writeBytes, writableBytes, setAngle, setBaud, nullptr};
+  wt_core_init(&core, &hooks, angle);
 }
 
 void loop() {
-  static boolean newDataReady = 0;
-  const int serialPrintInterval = 5; //increase value to slow down serial print activity
-  // Sends results
-  if (Serial.available() > 0) {
-    String keyword = Serial.readStringUntil(':');
-
-    if (keyword == "angle") {
-      int t_angle = Serial.parseInt();
-      angle = t_angle;
-      servo.write(angle);
-    } else if (keyword == "calibration_v") { 
-      float t_val = Serial.parseFloat();
-      calibration_v = t_val;
-      lc_v.setCalFactor(calibration_v);
-    } else if (keyword == "calibration_h") { 
-      float t_val = Serial.parseFloat();
-      calibration_h = t_val;
-      lc_h.setCalFactor(calibration_h);
-    } else if (keyword == "tare") {
-      lc_v.tareNoDelay();
-      lc_h.tareNoDelay();
-    } else if (keyword == "tare_v") {
-      lc_v.tareNoDelay();
-    } else if (keyword == "tare_h") {
-      lc_h.tareNoDelay();
-    } else if (keyword == "read") {
-      lc_v.update();
-      lc_h.update();
-
-      weight_v = lc_v.getData(); 
-      weight_h = lc_h.getData(); 
-      buffer = String(weight_v, 2) + ":" + String(weight_h, 2);
-      Serial.println(buffer);
-
-      // serialFlush();
-    } else {
-      serialFlush();
-    }
+  // Both load cells are polled on every iteration (update() only reads the HX711 once it has a conversion ready),
+  //   so every reply, streamed or requested, carries the latest data
+  bool fresh_v = lc_v.update();
+  bool fresh_h = lc_h.update();
+  if (fresh_v || fresh_h) {
+    wt_core_reading(&core, micros(), lc_v.getData(), lc_h.getData());
   }
+
+  // Handles commands: only the bytes that have already arrived are fed into the frame receiver, so nothing waits
+  int available = Serial.available();
+  while (available-- > 0) {
+    wt_core_receive(&core, (uint8_t)Serial.read(), micros());
+  }
+
+  wt_core_poll(&core, micros());
 }
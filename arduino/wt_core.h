@@ -0,0 +1,193 @@
+// Wind Tunnel Firmware Core
+//   The protocol and state machine of duo_sketch.ino, without any Arduino dependency, so the exact same code runs in
+//   the sketch and in tools/simulator.cpp (and can be built and profiled on the host).
+//   Like wt_protocol.h it only relies on <stdint.h>/<string.h>: fixed buffers, no heap allocation, nothing blocks.
+//
+// The board specific parts (servo, serial port) are reached through WtCoreHooks. The load cells are reported as raw
+// counts (the host applies the calibration and tares), so the core has no calibration state. The sketch's loop():
+// - polls both load cells every iteration and passes each new conversion to wt_core_reading(), so every reply carries
+//   the latest data instead of whatever was read when the last command arrived;
+// - feeds whatever serial bytes have arrived into wt_core_receive(), one at a time, which decodes and applies commands;
+// - calls wt_core_poll(), which pushes a streamed sample once one is due and the port has room for it, and falls back
+//   to a slower link rate when the host stops being heard (see "Link speed" in wt_protocol.h).
+
+#ifndef WT_CORE_H
+#define WT_CORE_H
+
+#include "wt_protocol.h"
+
+struct WtCoreHooks {
+  // Sends bytes. Never called with more than writable() bytes, if writable is set.
+  void (*write)(void* context, const uint8_t* data, uint16_t length);
+  // Free space in the transmit buffer, so streamed samples wait instead of blocking the loop (nullptr: unlimited)
+  uint16_t (*writable)(void* context);
+  void (*set_angle)(void* context, int16_t angle);
+  // Switches the port to another baud rate once everything already written has been sent (nullptr: WT_MSG_SET_BAUD
+  //   is refused)
+  void (*set_baud)(void* context, uint32_t baud);
+  void* context;
+};
+
+struct WtCore {
+  WtCoreHooks hooks;
+  WtReceiver receiver;
+  WtFrame frame;
+  uint8_t tx_buffer[WT_MAX_ENCODED_SIZE];
+  uint8_t tx_seq;
+
+  int16_t angle;
+
+  // Latest conversion of both load cells (raw counts), and micros() when it was read
+  float raw_v;
+  float raw_h;
+  uint32_t data_us;
+  bool new_data;
+
+  // When streaming, every new conversion is pushed to the host without waiting for a WT_MSG_READ request.
+  //   stream_interval_us limits how often a reading is sent (0 sends every conversion).
+  bool streaming;
+  uint32_t stream_interval_us;
+  uint32_t last_stream_us;
+
+  // Link rate: baud is in use, previous_baud is restored unless the switch is confirmed by a valid frame
+  uint32_t baud;
+  uint32_t previous_baud;
+  uint32_t pending_baud;   // requested, switched to once the acknowledgement is out (0: none)
+  bool baud_confirmed;
+  uint32_t baud_changed_us;
+  uint32_t last_rx_us;     // last valid frame
+
+  uint16_t frames_dropped; // replies that did not fit in the transmit buffer
+};
+
+static inline void wt_core_init(WtCore* core, const WtCoreHooks* hooks, int16_t angle) {
+  memset(core, 0, sizeof(*core));
+  core->hooks = *hooks;
+  core->angle = angle;
+  core->baud = WT_BASE_BAUD;
+  core->baud_confirmed = true;
+  wt_receiver_reset(&core->receiver);
+}
+
+static inline void wt_core_switch_baud(WtCore* core, uint32_t baud, bool confirmed, uint32_t now_us) {
+  core->previous_baud = core->baud;
+  core->baud = baud;
+  core->baud_confirmed = confirmed;
+  core->baud_changed_us = now_us;
+  core->last_rx_us = now_us;
+  wt_receiver_reset(&core->receiver); // whatever arrived at the old rate is garbage now
+  core->hooks.set_baud(core->hooks.context, baud);
+}
+
+// Encodes and sends a frame. Returns false (and sends nothing) if it does not fit in the transmit buffer.
+static inline bool wt_core_send(WtCore* core, uint8_t type, const uint8_t* payload, uint8_t length) {
+  uint16_t size = wt_encode_frame(type, core->tx_seq, payload, length, core->tx_buffer);
+  if (core->hooks.writable && core->hooks.writable(core->hooks.context) < size) {
+    return false;
+  }
+  core->tx_seq++;
+  core->hooks.write(core->hooks.context, core->tx_buffer, size);
+  return true;
+}
+
+static inline bool wt_core_send_sample(WtCore* core) {
+  uint8_t payload[WT_SAMPLE_SIZE];
+  wt_put_u32(payload, core->data_us);
+  wt_put_i16(payload + 4, core->angle);
+  wt_put_f32(payload + 6, core->raw_v);
+  wt_put_f32(payload + 10, core->raw_h);
+  return wt_core_send(core, WT_MSG_SAMPLE, payload, WT_SAMPLE_SIZE);
+}
+
+static inline bool wt_core_send_ident(WtCore* core) {
+  uint8_t payload[WT_IDENT_SIZE];
+  wt_put_u32(payload, WT_IDENT_MAGIC);
+  wt_put_i16(payload + 4, core->angle);
+  return wt_core_send(core, WT_MSG_IDENT, payload, WT_IDENT_SIZE);
+}
+
+// Records a new conversion (call it whenever either load cell has one)
+static inline void wt_core_reading(WtCore* core, uint32_t now_us, float raw_v, float raw_h) {
+  core->raw_v = raw_v;
+  core->raw_h = raw_h;
+  core->data_us = now_us;
+  core->new_data = true;
+}
+
+// Applies a decoded command from the host. Frames with an unexpected payload size are ignored.
+//   Returns true if the command should be acknowledged (READ and HELLO are answered by their reply instead).
+static inline bool wt_core_apply(WtCore* core, const WtFrame* f, uint32_t now_us) {
+  const WtCoreHooks* hooks = &core->hooks;
+  switch (f->type) {
+    case WT_MSG_SET_ANGLE:
+      if (f->length != WT_SET_ANGLE_SIZE) return false;
+      core->angle = wt_get_i16(f->payload);
+      hooks->set_angle(hooks->context, core->angle);
+      return true;
+    case WT_MSG_READ:
+      if (!wt_core_send_sample(core)) core->frames_dropped++;
+      return false;
+    case WT_MSG_STREAM_START: {
+      if (f->length != WT_STREAM_START_SIZE) return false;
+      uint16_t rate = wt_get_u16(f->payload); // samples per second, 0 sends every conversion
+      core->stream_interval_us = (rate > 0) ? 1000000UL / rate : 0;
+      core->last_stream_us = now_us - core->stream_interval_us; // the next conversion goes out right away
+      core->new_data = false;
+      core->streaming = true;
+      return true;
+    }
+    case WT_MSG_STREAM_STOP:
+      core->streaming = false;
+      return true;
+    case WT_MSG_HELLO:
+      if (!wt_core_send_ident(core)) core->frames_dropped++;
+      return false;
+    case WT_MSG_SET_BAUD: {
+      if (f->length != WT_SET_BAUD_SIZE || !hooks->set_baud) return false;
+      uint32_t baud = wt_get_u32(f->payload);
+      if (!wt_baud_supported(baud)) return false;
+      core->pending_baud = baud; // switched to in wt_core_receive(), after the acknowledgement
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// Feeds one received byte. Complete commands are applied and acknowledged immediately.
+static inline void wt_core_receive(WtCore* core, uint8_t byte, uint32_t now_us) {
+  if (wt_receiver_push(&core->receiver, byte, &core->frame) != WT_RX_FRAME) {
+    return;
+  }
+  core->last_rx_us = now_us;
+  core->baud_confirmed = true; // the host is talking at this rate
+  if (wt_core_apply(core, &core->frame, now_us)) {
+    // Acknowledges the command, so the host knows it was applied (and stops resending it)
+    uint8_t payload[WT_ACK_SIZE] = {core->frame.seq, core->frame.type};
+    if (!wt_core_send(core, WT_MSG_ACK, payload, WT_ACK_SIZE)) {
+      core->frames_dropped++;
+    } else if (core->pending_baud) {
+      // Only once the host has been told: without the acknowledgement it stays at the current rate too
+      wt_core_switch_baud(core, core->pending_baud, core->pending_baud == core->baud, now_us);
+    }
+  }
+  core->pending_baud = 0;
+}
+
+// Pushes the latest reading if streaming and it is due (rate limited by stream_interval_us).
+//   A sample that does not fit in the transmit buffer yet stays pending until a later call.
+//   Also reverts a rate switch the host never confirmed, and a fast link the host has stopped talking on.
+static inline void wt_core_poll(WtCore* core, uint32_t now_us) {
+  if (!core->baud_confirmed && (uint32_t)(now_us - core->baud_changed_us) >= WT_BAUD_CONFIRM_MS * 1000UL) {
+    wt_core_switch_baud(core, core->previous_baud, true, now_us);
+  } else if (core->baud != WT_BASE_BAUD && (uint32_t)(now_us - core->last_rx_us) >= WT_LINK_TIMEOUT_MS * 1000UL) {
+    wt_core_switch_baud(core, WT_BASE_BAUD, true, now_us);
+  }
+  if (core->streaming && core->new_data && (uint32_t)(now_us - core->last_stream_us) >= core->stream_interval_us
+      && wt_core_send_sample(core)) {
+    core->last_stream_us = now_us;
+    core->new_data = false;
+  }
+}
+
+#endif // WT_CORE_H
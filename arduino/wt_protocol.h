@@ -0,0 +1,273 @@
+// Wind Tunnel Wire Protocol
+//   Shared by the C++ program (main.cpp) and the Arduino sketch (duo_sketch.ino), so both ends always agree on the layout.
+//   This header only relies on <stdint.h>/<string.h> so that it also compiles for the Arduino UNO (no STL, no heap).
+//
+// Every message is a frame of:
+//   [version: u8][type: u8][seq: u8][payload: 0..WT_MAX_PAYLOAD bytes][crc: u16]
+// - All multi-byte fields are little-endian. Floats are IEEE-754 binary32 (the UNO's float) and are sent bit-for-bit.
+// - seq is incremented by the sender for every frame it sends, so the receiver can count lost frames.
+// - crc is CRC-16/CCITT-FALSE over everything before it.
+// The frame is then COBS encoded (so it contains no zero bytes) and terminated with a single 0x00 delimiter.
+// A receiver that joins mid-stream or sees a corrupted frame simply resynchronizes on the next 0x00.
+
+#ifndef WT_PROTOCOL_H
+#define WT_PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define WT_PROTOCOL_VERSION 6
+
+// Frame sizes
+#define WT_HEADER_SIZE 3
+#define WT_CRC_SIZE 2
+#define WT_MAX_PAYLOAD 32
+#define WT_MAX_FRAME_SIZE (WT_HEADER_SIZE + WT_MAX_PAYLOAD + WT_CRC_SIZE)
+#define WT_MAX_ENCODED_SIZE (WT_MAX_FRAME_SIZE + (WT_MAX_FRAME_SIZE / 254) + 2) // COBS overhead + delimiter
+
+// Message types (host -> Arduino)
+#define WT_MSG_SET_ANGLE     0x01 // i16 angle (absolute servo angle)
+// 0x02-0x04 set the calibration factors and tared the load cells up to version 3; the host calibrates since version 4
+#define WT_MSG_READ          0x05 // (empty) requests a single WT_MSG_SAMPLE
+#define WT_MSG_STREAM_START  0x06 // u16 maximum samples per second (0 = every conversion)
+#define WT_MSG_STREAM_STOP   0x07 // (empty)
+#define WT_MSG_HELLO         0x08 // (empty) asks the device to identify itself with WT_MSG_IDENT (used to find its port)
+#define WT_MSG_SET_BAUD      0x09 // u32 baud rate: acknowledged at the current rate, then the device switches (see below)
+
+// Message types (Arduino -> host)
+#define WT_MSG_SAMPLE        0x81 // u32 micros() when measured, i16 angle, f32 raw vertical counts, f32 raw horizontal counts
+#define WT_MSG_ACK           0x82 // u8 seq, u8 type of the command that was applied (sent for every command except READ and HELLO)
+#define WT_MSG_IDENT         0x83 // u32 WT_IDENT_MAGIC, i16 angle (the servo angle the device currently holds)
+
+// Identifies the wind tunnel sketch in WT_MSG_IDENT ("WTUN")
+#define WT_IDENT_MAGIC 0x4E555457UL
+
+// Payload sizes
+#define WT_SET_ANGLE_SIZE 2
+#define WT_STREAM_START_SIZE 2
+#define WT_SAMPLE_SIZE 14
+#define WT_ACK_SIZE 2
+#define WT_IDENT_SIZE 6
+#define WT_SET_BAUD_SIZE 4
+
+// Link speed
+//   Both ends start at WT_BASE_BAUD. The host may then ask for a faster rate with WT_MSG_SET_BAUD: the device sends
+//   the WT_MSG_ACK at the old rate, then switches. It goes back to the previous rate unless a valid frame arrives at
+//   the new one within WT_BAUD_CONFIRM_MS, and back to WT_BASE_BAUD after WT_LINK_TIMEOUT_MS without any valid frame,
+//   so a host that gave up on a rate (or went away) always finds the device at WT_BASE_BAUD again. The host keeps a
+//   fast link alive by sending something (WT_MSG_HELLO if nothing else) at least every WT_KEEPALIVE_MS.
+#define WT_BASE_BAUD 115200UL
+#define WT_BAUD_CONFIRM_MS 1000UL
+#define WT_LINK_TIMEOUT_MS 2000UL
+#define WT_KEEPALIVE_MS 500UL
+
+// Rates WT_MSG_SET_BAUD accepts (any other is not acknowledged): the base rate, and the rates the UNO's 16 MHz clock
+//   divides exactly (no bit timing error) that are also standard termios speeds on the host
+static inline bool wt_baud_supported(uint32_t baud) {
+  switch (baud) {
+    case 115200UL:
+    case 500000UL:
+    case 1000000UL:
+    case 2000000UL:
+      return true;
+    default:
+      return false;
+  }
+}
+
+struct WtFrame {
+  uint8_t version;
+  uint8_t type;
+  uint8_t seq;
+  uint8_t length; // payload length
+  uint8_t payload[WT_MAX_PAYLOAD];
+};
+
+// Incremental frame receiver, fed one byte at a time (see wt_receiver_push)
+struct WtReceiver {
+  uint8_t buffer[WT_MAX_ENCODED_SIZE];
+  uint8_t length;
+  bool overflow;
+};
+
+// Return values of wt_receiver_push
+#define WT_RX_PENDING 0  // frame not complete yet
+#define WT_RX_FRAME 1    // a valid frame was written to the output
+#define WT_RX_ERROR -1   // a frame was dropped (bad COBS, bad CRC, wrong version or too long)
+
+// Little-endian field helpers
+static inline void wt_put_u16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)(v & 0xFF);
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline uint16_t wt_get_u16(const uint8_t* p) {
+  return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+
+static inline void wt_put_i16(uint8_t* p, int16_t v) {
+  wt_put_u16(p, (uint16_t)v);
+}
+
+static inline int16_t wt_get_i16(const uint8_t* p) {
+  return (int16_t)wt_get_u16(p);
+}
+
+static inline void wt_put_u32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)(v & 0xFF);
+  p[1] = (uint8_t)((v >> 8) & 0xFF);
+  p[2] = (uint8_t)((v >> 16) & 0xFF);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t wt_get_u32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void wt_put_f32(uint8_t* p, float v) {
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  wt_put_u32(p, bits);
+}
+
+static inline float wt_get_f32(const uint8_t* p) {
+  uint32_t bits = wt_get_u32(p);
+  float v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), bitwise to avoid a 512 byte table on the UNO
+static inline uint16_t wt_crc16(const uint8_t* data, uint16_t length) {
+  uint16_t crc = 0xFFFF;
+  for (uint16_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// COBS encodes length bytes of input into output (which must hold length + length/254 + 1 bytes).
+//   Returns the encoded length, not including the 0x00 delimiter.
+static inline uint16_t wt_cobs_encode(const uint8_t* input, uint16_t length, uint8_t* output) {
+  uint16_t read_index = 0;
+  uint16_t write_index = 1;
+  uint16_t code_index = 0;
+  uint8_t code = 1;
+
+  while (read_index < length) {
+    if (input[read_index] == 0) {
+      output[code_index] = code;
+      code = 1;
+      code_index = write_index++;
+      read_index++;
+    } else {
+      output[write_index++] = input[read_index++];
+      code++;
+      if (code == 0xFF) {
+        output[code_index] = code;
+        code = 1;
+        code_index = write_index++;
+      }
+    }
+  }
+  output[code_index] = code;
+  return write_index;
+}
+
+// Decodes length COBS bytes (without the delimiter) into output.
+//   Returns the decoded length, or 0 if the input is not valid COBS.
+static inline uint16_t wt_cobs_decode(const uint8_t* input, uint16_t length, uint8_t* output) {
+  uint16_t read_index = 0;
+  uint16_t write_index = 0;
+
+  while (read_index < length) {
+    uint8_t code = input[read_index];
+    if (code == 0 || (uint16_t)(read_index + code) > length) {
+      return 0;
+    }
+    read_index++;
+    for (uint8_t i = 1; i < code; i++) {
+      output[write_index++] = input[read_index++];
+    }
+    if (code != 0xFF && read_index != length) {
+      output[write_index++] = 0;
+    }
+  }
+  return write_index;
+}
+
+// Builds a complete, COBS encoded frame (including the trailing 0x00) into output, which must hold WT_MAX_ENCODED_SIZE bytes.
+//   Returns the number of bytes to send, or 0 if the payload is too long.
+static inline uint16_t wt_encode_frame(uint8_t type, uint8_t seq, const uint8_t* payload, uint8_t length, uint8_t* output) {
+  if (length > WT_MAX_PAYLOAD) {
+    return 0;
+  }
+  uint8_t raw[WT_MAX_FRAME_SIZE];
+  raw[0] = WT_PROTOCOL_VERSION;
+  raw[1] = type;
+  raw[2] = seq;
+  if (length > 0) {
+    memcpy(raw + WT_HEADER_SIZE, payload, length);
+  }
+  uint16_t crc = wt_crc16(raw, WT_HEADER_SIZE + length);
+  wt_put_u16(raw + WT_HEADER_SIZE + length, crc);
+
+  uint16_t encoded = wt_cobs_encode(raw, WT_HEADER_SIZE + length + WT_CRC_SIZE, output);
+  output[encoded++] = 0;
+  return encoded;
+}
+
+// Decodes one COBS frame (without the 0x00 delimiter) and validates its CRC and version.
+static inline bool wt_decode_frame(const uint8_t* encoded, uint16_t length, WtFrame* frame) {
+  uint8_t raw[WT_MAX_ENCODED_SIZE];
+  if (length == 0 || length > WT_MAX_ENCODED_SIZE) {
+    return false;
+  }
+  uint16_t raw_length = wt_cobs_decode(encoded, length, raw);
+  if (raw_length < WT_HEADER_SIZE + WT_CRC_SIZE || raw_length > WT_MAX_FRAME_SIZE) {
+    return false;
+  }
+  uint16_t body_length = raw_length - WT_CRC_SIZE;
+  if (wt_crc16(raw, body_length) != wt_get_u16(raw + body_length)) {
+    return false;
+  }
+  if (raw[0] != WT_PROTOCOL_VERSION) {
+    return false;
+  }
+  frame->version = raw[0];
+  frame->type = raw[1];
+  frame->seq = raw[2];
+  frame->length = (uint8_t)(body_length - WT_HEADER_SIZE);
+  memcpy(frame->payload, raw + WT_HEADER_SIZE, frame->length);
+  return true;
+}
+
+static inline void wt_receiver_reset(WtReceiver* receiver) {
+  receiver->length = 0;
+  receiver->overflow = false;
+}
+
+// Feeds one received byte into the receiver. When a delimiter completes a valid frame it is written to frame.
+static inline int8_t wt_receiver_push(WtReceiver* receiver, uint8_t byte, WtFrame* frame) {
+  if (byte != 0) {
+    if (receiver->length < WT_MAX_ENCODED_SIZE) {
+      receiver->buffer[receiver->length++] = byte;
+    } else {
+      receiver->overflow = true;
+    }
+    return WT_RX_PENDING;
+  }
+
+  // Delimiter: an empty frame is just line noise between two delimiters
+  if (receiver->length == 0 && !receiver->overflow) {
+    return WT_RX_PENDING;
+  }
+  bool valid = !receiver->overflow && wt_decode_frame(receiver->buffer, receiver->length, frame);
+  wt_receiver_reset(receiver);
+  return valid ? WT_RX_FRAME : WT_RX_ERROR;
+}
+
+#endif // WT_PROTOCOL_H
@@ -6,11 +6,30 @@
 #include <string>
 #include <stdexcept>
 #include <chrono>
-#include <future>
 #include <fstream>
 #include <memory>
+#include <atomic>
+#include <ctime>
+#include <iomanip>
+#include <future>
 
 #include "serial/serial.h" // serial library
+#include "wt_protocol.h" // binary wire protocol shared with arduino/duo_sketch.ino
+#include "serial_engine.h" // I/O thread that owns the serial port
+#include "spsc_ring.h" // lock-free hand-off of samples from the I/O thread to the render loop
+#include "sample.h"
+#include "config.h" // shared defaults and config.txt
+#include "recording.h" // binary run recordings
+#include "replay.h"
+#include "plot_store.h" // min/max decimated plot data
+#include "sweep.h" // automated angle of attack sweeps
+#include "signal_stage.h" // filters and statistics on the acquisition thread
+#include "device.h" // additional devices
+#include "merger.h" // time alignment of all devices
+#include "histogram.h" // latency/throughput instrumentation
+#include "sample_feed.h" // live samples for other processes (shared memory)
+#include "spectrum.h" // FFT/spectrogram of the force channels, on a worker thread
+#include "controller.h" // closed-loop force control on the acquisition thread
 
 #include "implot.h"
 #include "imgui.h"
@@ -32,88 +51,103 @@
 // Angle Variables
 const int16_t MIN_ANGLE = -30;
 const int16_t MAX_ANGLE = 30;
-const int16_t BASE_ANGLE = 85;
-
-// Calibration Variables
-const float BASE_CALIBRATION_V = 714.0f;
-const float BASE_CALIBRATION_H = 116.0f;
 
 // Serial Variables
-const unsigned long BAUD = 115200;
-static std::string PORT = "/dev/cu.usbmodem11401"; // port for arduino
+static std::string PORT = DEFAULT_PORT;
+
+// Streaming Variables (HX711 converts at 10 or 80 samples per second depending on the RATE pin)
+const int MIN_STREAM_RATE = 0; // 0 asks the Arduino to push every conversion
+const int MAX_STREAM_RATE = 1000;
+const int BASE_STREAM_RATE = 80;
+
+// Sample Ring Variables (number of samples that can be buffered between two frames, override with --ring-capacity)
+const size_t BASE_RING_CAPACITY = 1 << 16;
 
 // OTHER STATIC VARIABLES
 static int16_t angle = BASE_ANGLE;
 static int16_t angle_rel = 0;
-static float calibration_v = BASE_CALIBRATION_V;
-static float calibration_h = BASE_CALIBRATION_H;
+static Calibration calibration = base_calibration(); // GUI copy; signal_stage applies it (see calibration.h)
 static bool rt_angle = true;
 static bool rt_graph = false;
-static bool rt_calibration = true;
+static bool rt_stream = true;
+static bool streaming = false;
+static int stream_rate = BASE_STREAM_RATE;
 static bool serial_open = false;
-static std::string serial_buffer;
-static std::string serial_result;
-static std::string readings;
 static float reading_v = 0.0f;
 static float reading_h = 0.0f;
-static std::mutex serial_buffer_mutex;
-static std::mutex serial_result_mutex;
 static float readings_per_second = 5.0f; 
-static std::vector<std::future<void>> reading_queue;
-static std::unique_ptr<serial::Serial> serial_port;
-
-// file stream stuff for saving/reading
-void save_config () {
-    std::ofstream stream{"config.txt"};
-    if (!stream) {
-        std::cerr << "Error: the config could not be opened or written to." << std::endl;
-        return;
+static std::atomic<int> samples_received{0};
+static SerialEngine serial_engine;
+static std::unique_ptr<SpscRing<Sample>> sample_ring;
+static Recorder recorder;
+static ReplayPlayer replay;
+static bool replay_mode = false;
+static Sweep sweep;
+static SweepSettings sweep_settings;
+static SignalStage signal_stage;
+static FilterSettings filter_settings;
+static CalibrationRoutine calibration_routine;
+static FeedPublisher feed; // written by the I/O threads, see sample_feed.h
+static SpectrumAnalyzer spectrum;
+static SpectrumSettings spectrum_settings;
+static ForceController controller; // updated on the I/O thread, see controller.h
+static ControllerSettings controller_settings;
+const size_t CONTROL_HISTORY = 4000; // control updates plotted in the Control window
+
+// Additional devices (e.g. a second balance), each with its own I/O thread and ring. The primary device above
+//   (serial_engine) is source 0 of the merger, attached devices follow in order.
+struct AttachedDevice {
+    std::unique_ptr<Device> device;
+    MinMaxPyramid vertical, horizontal;
+    std::string label_v, label_h;
+    uint16_t feed_source;
+};
+const double BASE_MERGE_RATE = 100.0; // merged rows per second
+static std::vector<AttachedDevice> attached;
+static uint16_t next_feed_source = 1; // the primary device is source 0 of the feed, ids are never reused
+static StreamMerger merger;
+static std::ofstream merged_output;
+
+// Render pacing: the main loop sleeps until there is input, new samples or a refresh is due, instead of redrawing at
+//   vsync all the time. Acquisition runs on the I/O threads regardless, and samples are drained on every wake.
+const double IDLE_REFRESH_RATE = 2.0;          // redraws per second without input or new data (low-power idle)
+const double MINIMIZED_DRAIN_INTERVAL = 0.05;  // seconds between drains while minimized
+const int INPUT_FRAMES = 3;                    // frames drawn after each input, so hover/animation states settle
+static int max_refresh_rate = 60;
+static bool low_power_idle = true;
+static std::atomic<Uint32> render_wake_event{0};
+static std::atomic<bool> render_wake_pending{false};
+
+// Wakes the main loop from any thread because new samples arrived (at most one wake event is queued at a time)
+void wake_render () {
+    if (render_wake_event != 0 && !render_wake_pending.exchange(true)) {
+        SDL_Event event;
+        SDL_zero(event);
+        event.type = render_wake_event;
+        SDL_PushEvent(&event);
     }
-    stream << calibration_v << std::endl;
-    stream << calibration_h << std::endl;
 }
 
-void load_config () {
-    std::vector<std::string> results;
-    std::ifstream stream{"config.txt"};
-    if (!stream) {
-        std::cerr << "Error: the config could not be opened or read from." << std::endl;
-        return;
+// Instrumentation of the render loop and the link (the serial engine and recorder keep their own histograms)
+static Histogram frame_time("render frame", "us");
+static Histogram ring_depth("sample ring depth", "samples");
+static Histogram sample_age("sample age at drain", "us");
+static Histogram link_rx("link receive", "bytes/s");
+static Histogram link_tx("link send", "bytes/s");
+
+// Plot data (the whole session is kept, see plot_store.h)
+static MinMaxPyramid angle_data, vertical_data, horizontal_data, vertical_filtered, horizontal_filtered;
+
+// Draws the part of a channel that is visible in the current plot, decimated to the plot's pixel width
+void plot_pyramid (const char* label, const MinMaxPyramid& data) {
+    static std::vector<double> xs, ys;
+    ImPlotRect limits = ImPlot::GetPlotLimits();
+    data.query(limits.X.Min, limits.X.Max, static_cast<int>(ImPlot::GetPlotSize().x), xs, ys);
+    if (!xs.empty()) {
+        ImPlot::PlotLine(label, xs.data(), ys.data(), static_cast<int>(xs.size()));
     }
-    std::string line;
-    while (std::getline(stream, line)) {
-        results.push_back(line);
-    }
-    calibration_v = std::stof(results[0]);
-    calibration_h = std::stof(results[1]);
 }
 
-// utility structure for realtime plot (taken from implot_demo.cpp)
-struct ScrollingBuffer {
-    int MaxSize;
-    int Offset;
-    ImVector<ImVec2> Data;
-    ScrollingBuffer(int max_size = 2000) {
-        MaxSize = max_size;
-        Offset  = 0;
-        Data.reserve(MaxSize);
-    }
-    void AddPoint(float x, float y) {
-        if (Data.size() < MaxSize)
-            Data.push_back(ImVec2(x,y));
-        else {
-            Data[Offset] = ImVec2(x,y);
-            Offset =  (Offset + 1) % MaxSize;
-        }
-    }
-    void Erase() {
-        if (Data.size() > 0) {
-            Data.shrink(0);
-            Offset  = 0;
-        }
-    }
-};
-
 void update_angle() {
     angle = BASE_ANGLE + angle_rel;
 }
@@ -134,54 +168,290 @@ void enumerate_ports(std::vector<std::string> devices) {
     }
 }
 
-void read_from_serial () {
-    {
-        std::lock_guard<std::mutex> lock(serial_buffer_mutex);
-        serial_buffer = "read:";
-        serial_port->write(serial_buffer);
+// Frame and chunk handlers, run on the serial engine's I/O thread. The samples of each read are collected into a block,
+//   filtered and summarized by signal_stage, passed to the force controller, and handed to the render loop through
+//   sample_ring.
+static std::vector<Sample> acquired;
+
+void handle_frame (const WtFrame& frame) {
+    Sample sample;
+    if (sample_from_frame(frame, serial_engine.get_clock(), host_time(), sample)) {
+        acquired.push_back(sample);
+    }
+}
+
+void handle_chunk () {
+    if (acquired.empty()) {
+        return;
     }
-   
-    std::lock_guard<std::mutex> result_lock(serial_result_mutex);
-    serial_result = serial_port->readline(100, "\n");
-    std::cout << "Received: " << serial_result;
+    signal_stage.process(acquired.data(), acquired.size());
+    // The controller reads the filtered forces, so it runs right after the signal stage and before the ring, feed and
+    //   render hand-off
+    controller.update(acquired.data(), acquired.size(), serial_engine);
+    for (const Sample& sample : acquired) {
+        sample_ring->push(sample);
+    }
+    feed.publish(acquired.data(), acquired.size(), 0);
+    samples_received += static_cast<int>(acquired.size());
+    acquired.clear();
+    wake_render();
+}
 
-    reading_v = std::stof(serial_result.substr(0, serial_result.find(':')));
-    reading_h = std::stof(serial_result.substr(serial_result.find(':') + 1, serial_result.find('\n')));
+void start_stream () {
+    serial_engine.start_stream(static_cast<uint16_t>(stream_rate));
+    streaming = true;
 }
 
+void stop_stream () {
+    serial_engine.stop_stream();
+    streaming = false;
+}
+
+// Sends the angle (the calibration is applied on the host, so it needs no sending)
 void update_to_serial () {
     update_angle();
-    std::lock_guard<std::mutex> lock(serial_buffer_mutex);
-    serial_buffer = "angle:" + std::to_string(angle) 
-                  + "calibration_v:" + std::to_string(calibration_v)
-                  + "calibration_h:" + std::to_string(calibration_h);
-    serial_port->write(serial_buffer);
-    std::cout << "Sent: " << serial_buffer << std::endl;
+    serial_engine.send_angle(angle);
+}
+
+// Starts looking for the Arduino, on PORT and every USB serial port in parallel, without waiting for it: the serial
+//   engine's I/O thread finds it (and finds it again whenever the link drops). The load cells are zeroed once the
+//   first samples arrive, like the sketch used to on boot.
+void open_serial () {
+    std::cout << "Looking for the wind tunnel on " << PORT << " and every USB serial port, at baud rate " << BAUD << std::endl;
+    serial_engine.connect(PORT, BAUD);
+    serial_open = true;
+    signal_stage.tare(CHANNEL_V | CHANNEL_H);
+}
+
+// Starts recording every sample to run_<date>_<time>.wtr in the working directory. With devices attached, the merged
+//   stream of all devices is also written to merged_<date>_<time>.csv.
+void start_recording () {
+    char name[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(name, sizeof(name), "run_%Y%m%d_%H%M%S.wtr", std::localtime(&now));
+    recorder.open(name, {PORT, signal_stage.get_calibration(), BASE_ANGLE}, host_time());
+
+    if (!attached.empty()) {
+        std::strftime(name, sizeof(name), "merged_%Y%m%d_%H%M%S.csv", std::localtime(&now));
+        merged_output.open(name);
+        merged_output << "time_s," << PORT << "_v," << PORT << "_h";
+        for (const AttachedDevice& a : attached) {
+            merged_output << ',' << a.device->get_port() << "_v," << a.device->get_port() << "_h";
+        }
+        merged_output << '\n' << std::fixed << std::setprecision(6);
+    }
+}
+
+void stop_recording () {
+    recorder.close();
+    if (merged_output.is_open()) {
+        merged_output.close();
+    }
+}
+
+// Attaches another device on port, streaming at the same rate as the primary one
+void attach_device (const std::string& port, size_t ring_capacity) {
+    for (const AttachedDevice& a : attached) {
+        if (a.device->get_port() == port) {
+            std::cerr << "Error: " << port << " is already attached." << std::endl;
+            return;
+        }
+    }
+    AttachedDevice a;
+    a.device = std::make_unique<Device>(ring_capacity);
+    a.device->set_data_handler(wake_render);
+    a.device->get_stage().set_calibration(calibration);
+    a.feed_source = next_feed_source++;
+    a.device->set_feed(&feed, a.feed_source);
+    try {
+        if (!a.device->open(port, BAUD, static_cast<uint16_t>(stream_rate))) {
+            return;
+        }
+    } catch (const serial::IOException& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return;
+    }
+    a.label_v = port + " Vertical";
+    a.label_h = port + " Horizontal";
+    attached.push_back(std::move(a));
+    merger.configure(attached.size() + 1, 1.0 / BASE_MERGE_RATE);
+}
+
+void detach_device (size_t index) {
+    attached.erase(attached.begin() + index);
+    merger.configure(attached.size() + 1, 1.0 / BASE_MERGE_RATE);
+}
+
+void export_polar () {
+    char name[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(name, sizeof(name), "polar_%Y%m%d_%H%M%S.csv", std::localtime(&now));
+    sweep.export_csv(name);
+}
+
+void export_peaks () {
+    char name[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(name, sizeof(name), "peaks_%Y%m%d_%H%M%S.csv", std::localtime(&now));
+    spectrum.export_peaks(name);
+}
+
+// Empties the sample ring without processing anything
+void discard_samples () {
+    static Sample discarded[1024];
+    while (sample_ring->pop(discarded, IM_ARRAYSIZE(discarded)) > 0) {
+    }
+}
+
+// Drains every sample received since the last call from the rings into the plot data, the recorder, the sweep, the
+//   spectrum analyzer and the merger. Called on every wake of the main loop, whether or not a frame is rendered (e.g. while minimized).
+//   Only real samples are stored, at their device timestamps (including the angle the Arduino reported).
+void drain_samples () {
+    const int base_angle = replay_mode ? replay.get_header().base_angle : BASE_ANGLE;
+    static Sample drained[1024];
+    size_t drained_count;
+    ring_depth.record(sample_ring->size());
+    while ((drained_count = sample_ring->pop(drained, IM_ARRAYSIZE(drained))) > 0) {
+        if (!replay_mode) {
+            const double now = host_time();
+            for (size_t i = 0; i < drained_count; i++) {
+                sample_age.record(static_cast<uint64_t>(std::max(0.0, now - drained[i].t) * 1e6));
+            }
+        }
+        for (size_t i = 0; i < drained_count; i++) {
+            vertical_data.add(drained[i].t, drained[i].v);
+            horizontal_data.add(drained[i].t, drained[i].h);
+            vertical_filtered.add(drained[i].t, drained[i].v_filtered);
+            horizontal_filtered.add(drained[i].t, drained[i].h_filtered);
+            angle_data.add(drained[i].t, drained[i].angle - base_angle);
+            if (recorder.is_open()) {
+                recorder.append(drained[i].t, drained[i].raw_v, drained[i].raw_h, drained[i].angle);
+            }
+            sweep.update(drained[i]);
+            calibration_routine.update(drained[i]);
+            merger.add(0, drained[i]);
+        }
+        spectrum.add(drained, drained_count);
+        reading_v = drained[drained_count - 1].v;
+        reading_h = drained[drained_count - 1].h;
+    }
+
+    // Attached devices are drained the same way, then all devices are merged onto the common timebase
+    for (size_t d = 0; d < attached.size(); d++) {
+        AttachedDevice& a = attached[d];
+        while ((drained_count = a.device->get_ring().pop(drained, IM_ARRAYSIZE(drained))) > 0) {
+            for (size_t i = 0; i < drained_count; i++) {
+                a.vertical.add(drained[i].t, drained[i].v);
+                a.horizontal.add(drained[i].t, drained[i].h);
+                merger.add(d + 1, drained[i]);
+            }
+        }
+    }
+    static std::vector<MergedRow> merged_rows;
+    merged_rows.clear();
+    merger.merge(merged_rows);
+    if (merged_output.is_open()) {
+        for (const MergedRow& row : merged_rows) {
+            merged_output << row.t;
+            for (float value : row.values) {
+                merged_output << ',' << value;
+            }
+            merged_output << '\n';
+        }
+    }
+}
+
+// Every histogram along the path from the link to the screen, in that order
+std::vector<const Histogram*> all_histograms () {
+    return {&serial_engine.get_command_rtt(), &serial_engine.get_read_rtt(), &serial_engine.get_parse_time(),
+            &serial_engine.get_search_time(), &serial_engine.get_control_latency(), &link_rx, &link_tx, &ring_depth, &sample_age, &frame_time, &recorder.get_write_latency(),
+            &spectrum.get_transform_time()};
+}
+
+// Writes every histogram (and the frame counters) to metrics_<date>_<time>.txt
+void dump_metrics () {
+    char name[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(name, sizeof(name), "metrics_%Y%m%d_%H%M%S.txt", std::localtime(&now));
+    std::ofstream file(name);
+    if (!file.is_open()) {
+        std::cerr << "Error: could not open " << name << " for writing." << std::endl;
+        return;
+    }
+    file << "# frames corrupted " << serial_engine.get_frames_corrupted() << ", lost " << serial_engine.get_frames_lost()
+         << ", ring overflows " << sample_ring->overflows() << ", commands failed " << serial_engine.get_commands_failed() << "\n\n";
+    for (const Histogram* histogram : all_histograms()) {
+        histogram->write(file);
+    }
+    std::cout << "Metrics saved to " << name << std::endl;
+}
+
+// Parses the optional command line flags: --ring-capacity <samples>, --replay <file.wtr>, --feed <name|none>
+void parse_arguments (int argc, char** argv, size_t& ring_capacity, std::string& replay_path, std::string& feed_name) {
+    ring_capacity = BASE_RING_CAPACITY;
+    feed_name = DEFAULT_FEED_NAME;
+    for (int i = 1; i + 1 < argc; i++) {
+        std::string flag = argv[i];
+        if (flag == "--ring-capacity") {
+            try {
+                ring_capacity = std::stoul(argv[i + 1]);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: invalid --ring-capacity \"" << argv[i + 1] << "\", using " << BASE_RING_CAPACITY << std::endl;
+            }
+        } else if (flag == "--replay") {
+            replay_path = argv[i + 1];
+        } else if (flag == "--feed") {
+            feed_name = argv[i + 1];
+        }
+    }
 }
 
 // Main code
-int main(int, char**)
+int main(int argc, char** argv)
 {
-    std::vector<std::string> port_names = gather_ports();
+    size_t ring_capacity;
+    std::string replay_path;
+    std::string feed_name;
+    parse_arguments(argc, argv, ring_capacity, replay_path, feed_name);
+    sample_ring = std::make_unique<SpscRing<Sample>>(ring_capacity);
+    merger.configure(1, 1.0 / BASE_MERGE_RATE);
+    host_time(); // starts the sample clock
 
     // Introduction from console
     std::cout << "Starting Wind Tunnel Program V2..." << std::endl;
-    enumerate_ports(port_names);
 
-    // Attempts to open the serial port 
-    try {
-        serial_port = std::make_unique<serial::Serial>(PORT, BAUD, serial::Timeout::simpleTimeout(1000));
-        if (serial_port->isOpen()) {
-            std::cout << "Serial port is open on port " + PORT + ", and listening on baud rate of " + std::to_string(BAUD) << std::endl;
-            serial_open = true;
-        } else {
-            std::cout << "Serial port did not open. Here is a list of ports that you could choose from:" << std::endl;
+    // The ports (listed in the Debug and Devices windows) are gathered in the background, so the window opens right away
+    std::vector<std::string> port_names;
+    std::future<std::vector<std::string>> port_list = std::async(std::launch::async, gather_ports);
+
+    load_config(calibration);
+    signal_stage.set_calibration(calibration);
+
+    // Replays a recording instead of connecting: the player feeds sample_ring just like the serial engine would.
+    //   The run starts out with the calibration it was recorded with.
+    if (!replay_path.empty()) {
+        if (!replay.open(replay_path)) {
+            return -1;
         }
-    } catch (const serial::IOException& e) {
-        std::cerr << "Error: " << e.what()  << std::endl;
+        std::cout << "Replaying " << replay_path << " (" << replay.get_duration() << " s, recorded on " << replay.get_header().port << ")" << std::endl;
+        calibration = replay.get_calibration();
+        signal_stage.set_calibration(calibration);
+        replay.start(*sample_ring, &signal_stage);
+        replay_mode = true;
     }
 
-    load_config();
+    // Live samples are shared with other local processes (not replays, which are already on disk)
+    if (!replay_mode && feed_name != "none") {
+        feed.open(feed_name, BASE_ANGLE);
+    }
+    spectrum.start();
+
+    // Attempts to open the serial port 
+    serial_engine.set_frame_handler(handle_frame);
+    serial_engine.set_chunk_handler(handle_chunk);
+    if (!replay_mode) {
+        open_serial();
+    }
 
     // Setup SDL
     // [If using SDL_MAIN_USE_CALLBACKS: all code below until the main loop starts would likely be your SDL_AppInit() function]
@@ -302,7 +572,8 @@ int main(int, char**)
     bool show_graph_window = true;
     bool show_main_window = true;
 
-    if (!serial_open) {
+    // Replays keep it: its calibration fields and Load/Save recalibrate the recorded raw counts
+    if (!serial_open && !replay_mode) {
         show_main_window = false;
     }
     
@@ -312,6 +583,15 @@ int main(int, char**)
 
     // Main loop
     bool done = false;
+    render_wake_event = SDL_RegisterEvents(1);
+    double last_render = 0.0;
+    bool data_ready = false;
+    int input_frames = INPUT_FRAMES;
+    // Time of the next redraw: at max_refresh_rate while there is input, new data or a playing replay, otherwise idle
+    auto render_due = [&]() {
+        const bool busy = input_frames > 0 || data_ready || !low_power_idle || (replay_mode && !replay.is_paused());
+        return last_render + 1.0 / (busy ? max_refresh_rate : IDLE_REFRESH_RATE);
+    };
 #ifdef __EMSCRIPTEN__
     // For an Emscripten build we are disabling file-system access, so let's not attempt to do a fopen() of the imgui.ini file.
     // You may manually call LoadIniSettingsFromMemory() to load settings from your own storage.
@@ -327,22 +607,53 @@ int main(int, char**)
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or clear/overwrite your copy of the keyboard data.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
         // [If using SDL_MAIN_USE_CALLBACKS: call ImGui_ImplSDL3_ProcessEvent() from your SDL_AppEvent() function]
+        // Sleeps until input, new samples (render_wake_event) or the next refresh is due
+        const bool minimized = SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED;
+        double next_render = render_due();
+        if (minimized) {
+            next_render = host_time() + MINIMIZED_DRAIN_INTERVAL;
+        }
+#ifdef __EMSCRIPTEN__
+        const Sint32 wait_ms = 0; // the browser paces the main loop
+#else
+        const Sint32 wait_ms = static_cast<Sint32>(std::max(0.0, next_render - host_time()) * 1000.0);
+#endif
+        bool input = false;
         SDL_Event event;
-        while (SDL_PollEvent(&event))
-        {
-            ImGui_ImplSDL3_ProcessEvent(&event);
-            if (event.type == SDL_EVENT_QUIT)
-                done = true;
-            if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED && event.window.windowID == SDL_GetWindowID(window))
-                done = true;
+        if (SDL_WaitEventTimeout(&event, wait_ms)) {
+            do {
+                if (event.type == render_wake_event) {
+                    render_wake_pending = false;
+                    data_ready = true;
+                    continue;
+                }
+                input = true;
+                ImGui_ImplSDL3_ProcessEvent(&event);
+                if (event.type == SDL_EVENT_QUIT)
+                    done = true;
+                if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED && event.window.windowID == SDL_GetWindowID(window))
+                    done = true;
+            } while (SDL_PollEvent(&event));
         }
+        if (input) {
+            input_frames = INPUT_FRAMES;
+        }
+
+        // Samples are drained on every wake, so none are lost while the window is minimized or not redrawn
+        drain_samples();
 
         // [If using SDL_MAIN_USE_CALLBACKS: all code below would likely be your SDL_AppIterate() function]
-        if (SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED)
-        {
-            SDL_Delay(10);
+        if (minimized)
             continue;
-        }
+        // New data is drawn at most max_refresh_rate times per second; input is drawn immediately
+        if (!input && host_time() < render_due())
+            continue;
+        last_render = host_time();
+        data_ready = false;
+        if (input_frames > 0)
+            input_frames--;
+
+        const double frame_start = host_time();
 
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -353,56 +664,106 @@ int main(int, char**)
         if (show_demo_window)
             ImGui::ShowDemoWindow(&show_demo_window);
 
+        // Takes the port list once it has been gathered
+        if (port_list.valid() && port_list.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            port_names = port_list.get();
+            enumerate_ports(port_names);
+        }
+
         // Debugging Window (in case something goes wrong during initialization)
         if (show_debug_window) {
             ImGui::Begin("Debug");
             ImGui::Text("Wind Tunnel Debugging Menu");
 
-            // Device Port Popup
-            static int selected_device = -1;
-            if (ImGui::Button("List Available Ports"))
+            // Device Port Popup: the ports are listed again each time it opens, and picking one searches there first
+            if (ImGui::Button("List Available Ports")) {
+                if (!port_list.valid()) {
+                    port_list = std::async(std::launch::async, gather_ports);
+                }
                 ImGui::OpenPopup("start_devices_popup");
+            }
             ImGui::SameLine();
-            ImGui::TextUnformatted(selected_device == -1 ? "<None>" : port_names[selected_device].c_str());
+            ImGui::TextUnformatted(PORT.c_str());
             if (ImGui::BeginPopup("start_devices_popup")) {
                 ImGui::SeparatorText("Device Ports");
                 for (size_t i = 0; i < port_names.size(); i++) {
                     if (ImGui::Selectable(port_names[i].c_str())) {
-                        selected_device = i;
-                        PORT = port_names[selected_device].c_str();
-                        std::cout << selected_device << " " << PORT << std::endl;
+                        PORT = port_names[i];
+                        if (!replay_mode) {
+                            open_serial();
+                        }
                     }
                 }
                 ImGui::EndPopup();
             }
 
-            if (!serial_open) {
-                ImGui::TextWrapped("If you are seeing this message, the serial port did not open correctly. "
-                                   "Please see if the desired port is available, or select the correct port using the dropdown above. "
-                                   "Once selected, press 'Start' to attempt the serial connection. If successful, the text will disappear.");
+            if (serial_open && !serial_engine.is_connected()) {
+                ImGui::TextWrapped("Looking for the wind tunnel on every serial port... Plug in the Arduino, or pick its port above if it is not "
+                                   "a USB serial port. The dashboard connects as soon as it answers.");
             }
 
-            if (ImGui::Button("Start")) {
-                if (!serial_open) {
-                    try {
-                        serial_port = std::make_unique<serial::Serial>(PORT, BAUD, serial::Timeout::simpleTimeout(1000));
-                        if (serial_port->isOpen()) {
-                            std::cout << "Serial port is open on port " + PORT + ", and listening on baud rate of " + std::to_string(BAUD) << std::endl;
-                            serial_open = true;
-                        } else {
-                            std::cout << "Serial port did not open. Here is a list of ports that you could choose from:" << std::endl;
-                        }
-                    } catch (const serial::IOException& e) {
-                        std::cerr << "Error: " << e.what()  << std::endl;
+            if (ImGui::Button(serial_open ? "Reconnect" : "Start") && !replay_mode) {
+                open_serial();
+            }
+
+            ImGui::Text("Current Port: %s (%s)", PORT.c_str(), link_state_name(serial_engine.get_link_state()));
+            ImGui::BulletText("Reconnects: %llu", static_cast<unsigned long long>(serial_engine.get_reconnects()));
+            ImGui::BulletText("Link rate: %lu baud (%llu fallbacks)", serial_engine.get_baud(),
+                              static_cast<unsigned long long>(serial_engine.get_baud_fallbacks()));
+            // Fastest rate negotiated after connecting (see serial_engine.h), from the next Reconnect on
+            if (ImGui::BeginCombo("Max link rate", std::to_string(serial_engine.get_max_baud()).c_str())) {
+                for (unsigned long rate : {BAUD, 500000UL, 1000000UL, 2000000UL}) {
+                    if (ImGui::Selectable(std::to_string(rate).c_str(), serial_engine.get_max_baud() == rate)) {
+                        serial_engine.set_max_baud(rate);
                     }
                 }
+                ImGui::EndCombo();
             }
 
-            ImGui::Text("Current Port: %s", PORT.c_str());
-
-            ImGui::BulletText("Remaining async operations: ");
-            ImGui::SameLine();
-            ImGui::Text("%d", static_cast<int>(reading_queue.size()));  
+            if (!serial_engine.get_error().empty()) {
+                ImGui::TextWrapped("Serial error: %s", serial_engine.get_error().c_str());
+            }
+            ImGui::BulletText("Sample ring: %d / %d (%llu overflowed)", static_cast<int>(sample_ring->size()), static_cast<int>(sample_ring->capacity()),
+                              static_cast<unsigned long long>(sample_ring->overflows()));
+            ImGui::BulletText("Bytes received: %llu", static_cast<unsigned long long>(serial_engine.get_bytes_received()));
+            ImGui::BulletText("Bytes sent: %llu", static_cast<unsigned long long>(serial_engine.get_bytes_sent()));
+            ImGui::BulletText("Corrupted frames: %llu", static_cast<unsigned long long>(serial_engine.get_frames_corrupted()));
+            ImGui::BulletText("Lost frames: %llu", static_cast<unsigned long long>(serial_engine.get_frames_lost()));
+            ImGui::BulletText("Commands: %llu acknowledged, %llu coalesced, %llu resent, %llu failed, %d waiting",
+                              static_cast<unsigned long long>(serial_engine.get_commands_acked()),
+                              static_cast<unsigned long long>(serial_engine.get_commands_coalesced()),
+                              static_cast<unsigned long long>(serial_engine.get_commands_resent()),
+                              static_cast<unsigned long long>(serial_engine.get_commands_failed()), serial_engine.get_commands_unacked());
+            if (feed.is_open()) {
+                ImGui::BulletText("Shared feed: %s, %llu samples published", feed.get_name().c_str(), static_cast<unsigned long long>(feed.get_published()));
+            } else {
+                ImGui::BulletText("Shared feed: off");
+            }
+            ImGui::BulletText("Device clock: offset %.6f s, drift %.1f ppm", serial_engine.get_clock().get_offset(), serial_engine.get_clock().get_drift_ppm());
+
+            // Latency and throughput percentiles of every stage
+            if (ImGui::BeginTable("metrics", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+                ImGui::TableSetupColumn("Metric");
+                ImGui::TableSetupColumn("Unit");
+                ImGui::TableSetupColumn("Count");
+                ImGui::TableSetupColumn("p50");
+                ImGui::TableSetupColumn("p99");
+                ImGui::TableSetupColumn("Max");
+                ImGui::TableHeadersRow();
+                for (const Histogram* histogram : all_histograms()) {
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted(histogram->get_name().c_str());
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted(histogram->get_unit().c_str());
+                    ImGui::TableNextColumn(); ImGui::Text("%llu", static_cast<unsigned long long>(histogram->count()));
+                    ImGui::TableNextColumn(); ImGui::Text("%llu", static_cast<unsigned long long>(histogram->percentile(50.0)));
+                    ImGui::TableNextColumn(); ImGui::Text("%llu", static_cast<unsigned long long>(histogram->percentile(99.0)));
+                    ImGui::TableNextColumn(); ImGui::Text("%llu", static_cast<unsigned long long>(histogram->max()));
+                }
+                ImGui::EndTable();
+            }
+            if (ImGui::Button("Dump Metrics")) {
+                dump_metrics();
+            }
 
             ImGui::End();
         }
@@ -411,98 +772,138 @@ int main(int, char**)
         if (show_main_window) {
             ImGui::Begin ("Variables");
             
-            // Displays the framerate
+            // Displays the framerate (frames are only drawn on input, new data, or at the idle rate)
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
+            ImGui::SliderInt("Max refresh rate (Hz)", &max_refresh_rate, 1, 240);
+            ImGui::Checkbox("Low-power idle", &low_power_idle);
 
-            // Variable Sliders
+            // Variable Sliders (the angle is driven by the sweep or the force controller while either is running, and
+            //   there is no servo to drive in a replay)
+            ImGui::BeginDisabled(replay_mode || sweep.is_running() || controller.is_active());
             if (ImGui::SliderScalar("Angle of Attack", ImGuiDataType_S16, &angle_rel, &MIN_ANGLE, &MAX_ANGLE) && rt_angle) {
                 update_angle();
-                std::lock_guard<std::mutex> lock(serial_buffer_mutex);
-                serial_buffer = "angle:" + std::to_string(angle);
-                serial_port->write(serial_buffer);
-                std::cout << "Sent: " << serial_buffer << std::endl;
+                serial_engine.send_angle(angle);
             }
-
-            if (ImGui::InputFloat("Vertical Calibration", &calibration_v, 1.0f, 1.0f, "%.3f") && rt_calibration) {
-                std::lock_guard<std::mutex> lock(serial_buffer_mutex);
-                serial_buffer = "calibration_v:" + std::to_string(calibration_v);
-                serial_port->write(serial_buffer);
-                std::cout << "Sent: " << serial_buffer << std::endl;
+            ImGui::EndDisabled();
+
+            // Calibration (applied to the raw counts on the host, so changes take effect immediately, also in replays).
+            //   Tares change the offsets on the acquisition thread, so the GUI copy is refreshed first.
+            calibration = signal_stage.get_calibration();
+            bool calibration_edited = false;
+            if (ImGui::InputDouble("Vertical Calibration", &calibration.factor_v, 1.0, 1.0, "%.3f")) calibration_edited = true;
+            if (ImGui::InputDouble("Horizontal Calibration", &calibration.factor_h, 1.0, 1.0, "%.3f")) calibration_edited = true;
+            if (ImGui::TreeNode("Offsets & Cross-talk")) {
+                if (ImGui::InputDouble("Vertical offset (counts)", &calibration.offset_v, 1.0, 100.0, "%.1f")) calibration_edited = true;
+                if (ImGui::InputDouble("Horizontal offset (counts)", &calibration.offset_h, 1.0, 100.0, "%.1f")) calibration_edited = true;
+                if (ImGui::InputDouble("Horizontal into vertical", &calibration.crosstalk_vh, 0.001, 0.01, "%.5f")) calibration_edited = true;
+                if (ImGui::InputDouble("Vertical into horizontal", &calibration.crosstalk_hv, 0.001, 0.01, "%.5f")) calibration_edited = true;
+                ImGui::TreePop();
             }
-
-            if (ImGui::InputFloat("Horizontal Calibration", &calibration_h, 1.0f, 1.0f, "%.3f") && rt_calibration) {
-                std::lock_guard<std::mutex> lock(serial_buffer_mutex);
-                serial_buffer = "calibration_h:" + std::to_string(calibration_h);
-                serial_port->write(serial_buffer);
-                std::cout << "Sent: " << serial_buffer << std::endl;
+            if (calibration_edited && calibration.factor_v != 0.0 && calibration.factor_h != 0.0) {
+                signal_stage.set_calibration(calibration);
             }
 
             // Sends the variables to be updated to the Arduino program via the Serial port.
+            ImGui::BeginDisabled(replay_mode);
             if (ImGui::Button("Update to Serial")) {
                 update_to_serial();
             }
 
             ImGui::Checkbox("Update angle in real time", &rt_angle);
-            ImGui::Checkbox("Update calibration in real time", &rt_calibration);
+
+            // Setpoints are coalesced (newest value wins) and sent at most this many times per second
+            static int command_rate = BASE_COMMAND_RATE;
+            if (ImGui::SliderInt("Command rate (Hz, 0 = unlimited)", &command_rate, 0, 200)) {
+                serial_engine.set_command_rate(static_cast<unsigned>(command_rate));
+            }
+            ImGui::EndDisabled();
 
             // Saves all variables to a .txt config file
             if (ImGui::Button("Save")) {
-                save_config();
+                save_config(calibration);
             }
             ImGui::SameLine();
-            if (ImGui::Button("Load")) {
-                load_config();
+            if (ImGui::Button("Load") && load_config(calibration)) {
+                signal_stage.set_calibration(calibration);
             }
 
             ImGui::End();
         }
 
         // IMPLOT GRAPH
-        // Initializes the plot data structs
-        static ScrollingBuffer angle_data, vertical_data, horizontal_data;
-        static float t = 0;
-        static float dt = 0;
-        t += ImGui::GetIO().DeltaTime;
-
-        // Handles asynchronous operations for read_from_serial():
-        //   If the vector contains a std::future object, then checks until that object is ready. If so, then delete it.
-        //   If the vector is empty AND we are looking for readings, then push a new std::future object into the vector.
-        //   This ensures that we only request data once the previous request is finished.
-        if (!reading_queue.empty()) {
-            auto status = reading_queue.front().wait_for(std::chrono::seconds(0));
-            if (status == std::future_status::ready) {
-                reading_queue.front().get();
-                reading_queue.erase(reading_queue.begin());
-                readings_per_second = 1.0f / (t - dt);
+        static double t = 0;
+        static double rate_t = 0;
+        t = replay_mode ? replay.get_position() : host_time(); // same clock as the sample timestamps
+
+        // The serial engine's I/O thread does all reads; here we only switch its mode whenever readings or streaming are toggled.
+        //   Streaming: the Arduino pushes every conversion. Polling: the I/O thread requests the next sample as soon as one arrives.
+        serial_open = serial_engine.is_open();
+        if (serial_engine.is_connected()) {
+            PORT = serial_engine.get_port(); // wherever the Arduino was found
+        }
+        if (serial_open) {
+            if ((rt_graph && rt_stream) != streaming) {
+                if (streaming)
+                    stop_stream();
+                else
+                    start_stream();
             }
+            serial_engine.set_polling(rt_graph && !rt_stream);
+        } else {
+            streaming = false;
+        }
+
+        // The rate is measured from the number of readings received each second
+        if (t - rate_t >= 1.0) {
+            readings_per_second = samples_received.exchange(0) / (t - rate_t);
+            rate_t = t;
+        }
+
+        // Link throughput, sampled once per second
+        static double link_t = host_time();
+        static uint64_t last_rx = 0, last_tx = 0;
+        if (host_time() - link_t >= 1.0) {
+            const double elapsed = host_time() - link_t;
+            const uint64_t rx = serial_engine.get_bytes_received(), tx = serial_engine.get_bytes_sent();
+            if (serial_open) {
+                link_rx.record(static_cast<uint64_t>((rx >= last_rx ? rx - last_rx : rx) / elapsed));
+                link_tx.record(static_cast<uint64_t>((tx >= last_tx ? tx - last_tx : tx) / elapsed));
+            }
+            last_rx = rx;
+            last_tx = tx;
+            link_t = host_time();
         }
-        if (rt_graph) {
-            if (reading_queue.empty()) {
-                reading_queue.push_back(std::async(std::launch::async, read_from_serial));
-                dt = t;
-            } 
-        } 
-
-        // Adds points to the data structs
-        angle_data.AddPoint(t, angle_rel);
-        vertical_data.AddPoint(t, reading_v);
-        horizontal_data.AddPoint(t, reading_h);
 
         static float history = 30.0f;
+        static bool follow_live = true;
 
         static ImPlotAxisFlags flags = ImPlotAxisFlags_NoTickLabels;
 
         if (show_graph_window) {
-            // Reading from serial
-            ImPlot::BeginPlot("Load Cell Forces", ImVec2(-1, 150));
-            ImPlot::SetupAxes(nullptr, nullptr, flags, flags);
-            ImPlot::SetupAxisLimits(ImAxis_X1, t - history, t, ImGuiCond_Always);
-            ImPlot::SetupAxisLimits(ImAxis_Y1, -20, 20);
-            ImPlot::SetNextFillStyle(IMPLOT_AUTO_COL, 0.5f);
-            ImPlot::PlotLine("Angle of Attack", &angle_data.Data[0].x, &angle_data.Data[0].y, angle_data.Data.size(),  0, angle_data.Offset, 2*sizeof(float));
-            ImPlot::PlotLine("Vertical Force", &vertical_data.Data[0].x, &vertical_data.Data[0].y, vertical_data.Data.size(),  0, vertical_data.Offset, 2*sizeof(float));
-            ImPlot::PlotLine("Horizontal Force", &horizontal_data.Data[0].x, &horizontal_data.Data[0].y, horizontal_data.Data.size(), 0, horizontal_data.Offset, 2*sizeof(float));
-            ImPlot::EndPlot();
+            // Reading from serial. While following, the x axis scrolls with the latest samples; otherwise it can be
+            //   panned and zoomed over the whole session
+            if (ImPlot::BeginPlot("Load Cell Forces", ImVec2(-1, 150))) {
+                ImPlot::SetupAxes(nullptr, nullptr, follow_live ? flags : ImPlotAxisFlags_None, flags);
+                if (follow_live)
+                    ImPlot::SetupAxisLimits(ImAxis_X1, t - history, t, ImGuiCond_Always);
+                ImPlot::SetupAxisLimits(ImAxis_Y1, -20, 20);
+                ImPlot::SetNextFillStyle(IMPLOT_AUTO_COL, 0.5f);
+                plot_pyramid("Angle of Attack", angle_data);
+                plot_pyramid("Vertical Force", vertical_data);
+                plot_pyramid("Horizontal Force", horizontal_data);
+                for (const AttachedDevice& a : attached) {
+                    plot_pyramid(a.label_v.c_str(), a.vertical);
+                    plot_pyramid(a.label_h.c_str(), a.horizontal);
+                }
+                if (signal_stage.get_settings().type != FilterType::None) {
+                    plot_pyramid("Vertical Force (filtered)", vertical_filtered);
+                    plot_pyramid("Horizontal Force (filtered)", horizontal_filtered);
+                }
+                ImPlot::EndPlot();
+            }
+            ImGui::Checkbox("Follow live", &follow_live);
+            ImGui::SameLine();
+            ImGui::Text("(%zu samples)", vertical_data.size());
 
             // RPS Metric
             ImGui::Text("%f readings per second", readings_per_second);
@@ -511,31 +912,496 @@ int main(int, char**)
             ImGui::Text("V: %f", reading_v);
             ImGui::SameLine();
             ImGui::Text("H: %f", reading_h);
+
+            // Statistics and filters (computed on the acquisition thread, see signal_stage.h)
+            if (ImGui::CollapsingHeader("Statistics & Filters")) {
+                ChannelStats stats_v, stats_h;
+                signal_stage.get_stats(stats_v, stats_h);
+                ImGui::Text("V: mean %.4f, stddev %.4f (%llu samples), window mean %.4f [%.4f, %.4f]", stats_v.mean, stats_v.stddev,
+                            static_cast<unsigned long long>(stats_v.count), stats_v.window_mean, stats_v.window_min, stats_v.window_max);
+                ImGui::Text("H: mean %.4f, stddev %.4f (%llu samples), window mean %.4f [%.4f, %.4f]", stats_h.mean, stats_h.stddev,
+                            static_cast<unsigned long long>(stats_h.count), stats_h.window_mean, stats_h.window_min, stats_h.window_max);
+                if (ImGui::Button("Reset Statistics")) {
+                    signal_stage.reset_stats();
+                }
+
+                if (ImGui::BeginCombo("Filter", filter_name(filter_settings.type))) {
+                    for (FilterType type : {FilterType::None, FilterType::LowPassBiquad, FilterType::LowPassFir, FilterType::Notch}) {
+                        if (ImGui::Selectable(filter_name(type), filter_settings.type == type)) {
+                            filter_settings.type = type;
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
+                if (ImGui::InputDouble(filter_settings.type == FilterType::Notch ? "Center (Hz)" : "Cutoff (Hz)", &filter_settings.frequency, 0.5, 5.0, "%.2f")) {
+                    const double rate = signal_stage.get_sample_rate();
+                    if (rate > 0.0) { // unknown until streaming starts; design() clamps it then
+                        filter_settings.frequency = std::clamp(filter_settings.frequency, MIN_FILTER_FREQUENCY * rate, MAX_FILTER_FREQUENCY * rate);
+                    }
+                }
+                if (filter_settings.type == FilterType::LowPassFir) {
+                    if (ImGui::InputInt("Taps", &filter_settings.fir_taps)) {
+                        filter_settings.fir_taps = std::clamp(filter_settings.fir_taps, MIN_FIR_TAPS, MAX_FIR_TAPS);
+                    }
+                } else if (filter_settings.type != FilterType::None) {
+                    if (ImGui::InputDouble("Q", &filter_settings.q, 0.1, 1.0, "%.3f")) {
+                        filter_settings.q = std::max(filter_settings.q, MIN_FILTER_Q);
+                    }
+                }
+                ImGui::InputInt("Window (samples)", &filter_settings.window);
+                if (ImGui::Button("Apply")) {
+                    signal_stage.configure(filter_settings);
+                }
+                ImGui::SameLine();
+                ImGui::Text("at %.1f samples/s", signal_stage.get_sample_rate());
+            }
+
+            // Spectrum of both channels and a scrolling spectrogram (computed on the analyzer's thread, see spectrum.h)
+            if (ImGui::CollapsingHeader("Spectrum")) {
+                static SpectrumView view;
+                static int spectrogram_channel = 0;
+                static float db_min = -80.0f, db_max = 20.0f;
+                spectrum.get_view(view);
+
+                if (ImGui::BeginCombo("FFT size", std::to_string(spectrum_settings.size).c_str())) {
+                    for (int size = MIN_SPECTRUM_SIZE; size <= MAX_SPECTRUM_SIZE; size <<= 1) {
+                        if (ImGui::Selectable(std::to_string(size).c_str(), spectrum_settings.size == size)) {
+                            spectrum_settings.size = size;
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
+                ImGui::SliderInt("Overlap (%)", &spectrum_settings.overlap, 0, 95);
+                if (ImGui::BeginCombo("Window", spectrum_window_name(spectrum_settings.window))) {
+                    for (SpectrumWindow window : {SpectrumWindow::Rectangular, SpectrumWindow::Hann, SpectrumWindow::Hamming, SpectrumWindow::BlackmanHarris}) {
+                        if (ImGui::Selectable(spectrum_window_name(window), spectrum_settings.window == window)) {
+                            spectrum_settings.window = window;
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
+                ImGui::InputDouble("Peak threshold (dB above floor)", &spectrum_settings.peak_threshold, 1.0, 5.0, "%.1f");
+                ImGui::InputInt("Spectrogram rows", &spectrum_settings.history);
+                if (ImGui::Button("Apply##spectrum")) {
+                    spectrum.configure(spectrum_settings);
+                    spectrum_settings = spectrum.get_settings();
+                }
+                ImGui::SameLine();
+                ImGui::Text("at %.1f samples/s, %.3f Hz per bin", view.sample_rate,
+                            view.bins > 1 ? view.sample_rate / (2 * (view.bins - 1)) : 0.0);
+
+                if (ImPlot::BeginPlot("Magnitude Spectrum", ImVec2(-1, 200))) {
+                    ImPlot::SetupAxes("Frequency (Hz)", "Amplitude (dB)", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+                    if (view.rows > 0) {
+                        const int bins = static_cast<int>(view.bins);
+                        ImPlot::PlotLine("Vertical", view.frequencies.data(), view.magnitude[0].data(), bins);
+                        ImPlot::PlotLine("Horizontal", view.frequencies.data(), view.magnitude[1].data(), bins);
+                    }
+                    ImPlot::EndPlot();
+                }
+
+                ImGui::RadioButton("Vertical##spectrogram", &spectrogram_channel, 0);
+                ImGui::SameLine();
+                ImGui::RadioButton("Horizontal##spectrogram", &spectrogram_channel, 1);
+                ImGui::SameLine();
+                ImGui::SetNextItemWidth(200);
+                ImGui::DragFloatRange2("dB range", &db_min, &db_max, 1.0f, -200.0f, 100.0f);
+                // The newest row is drawn on top, at the time of its last sample
+                if (ImPlot::BeginPlot("Spectrogram", ImVec2(-1, 250))) {
+                    ImPlot::SetupAxes("Frequency (Hz)", "Time (s)", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+                    if (view.rows > 0 && view.sample_rate > 0.0) {
+                        const double span = view.rows * view.hop / view.sample_rate;
+                        ImPlot::PushColormap(ImPlotColormap_Viridis);
+                        ImPlot::PlotHeatmap("##spectrogram", view.spectrogram[spectrogram_channel].data(), static_cast<int>(view.rows),
+                                            static_cast<int>(view.bins), db_min, db_max, nullptr,
+                                            ImPlotPoint(0.0, view.t - span), ImPlotPoint(view.sample_rate / 2.0, view.t));
+                        ImPlot::PopColormap();
+                    }
+                    ImPlot::EndPlot();
+                }
+
+                for (int c = 0; c < 2; c++) {
+                    const char* channel = c == 0 ? "Vertical" : "Horizontal";
+                    if (view.has_peak[c]) {
+                        ImGui::Text("%s: dominant %.2f Hz (%.1f dB)", channel, view.peak[c].frequency, view.peak[c].magnitude);
+                    } else {
+                        ImGui::Text("%s: no peak above the floor", channel);
+                    }
+                }
+                if (ImGui::Button("Export Peaks")) {
+                    export_peaks();
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Clear Peaks")) {
+                    spectrum.clear_peak_log();
+                }
+            }
         
             ImGui::Checkbox("Enable readings", &rt_graph);
             if (!rt_graph) {
                 ImGui::SameLine();
                 ImGui::Text("(paused)");
             }
+            ImGui::Checkbox("Stream readings", &rt_stream);
+            ImGui::SameLine();
+            if (ImGui::SliderInt("Stream rate (Hz, 0 = every conversion)", &stream_rate, MIN_STREAM_RATE, MAX_STREAM_RATE) && streaming) {
+                start_stream();
+            }
             if (ImGui::Button("Tare Scale")) {
-                std::lock_guard<std::mutex> lock(serial_buffer_mutex);
-                serial_buffer = "tare:";
-                serial_port->write(serial_buffer);
-                std::cout << "Sent: " << serial_buffer << std::endl;
+                signal_stage.tare(CHANNEL_V | CHANNEL_H);
             }
             if (ImGui::Button("Tare Vertical Scale")) {
-                std::lock_guard<std::mutex> lock(serial_buffer_mutex);
-                serial_buffer = "tare_v:";
-                serial_port->write(serial_buffer);
-                std::cout << "Sent: " << serial_buffer << std::endl;
+                signal_stage.tare(CHANNEL_V);
             }
             ImGui::SameLine();
             if (ImGui::Button("Tare Horizontal Scale")) {
-                std::lock_guard<std::mutex> lock(serial_buffer_mutex);
-                serial_buffer = "tare_h:";
-                serial_port->write(serial_buffer);
-                std::cout << "Sent: " << serial_buffer << std::endl;
+                signal_stage.tare(CHANNEL_H);
+            }
+            if (signal_stage.is_taring()) {
+                ImGui::SameLine();
+                ImGui::Text("(taring)");
+            }
+
+            // Recording
+            if (!replay_mode) {
+                if (ImGui::Button(recorder.is_open() ? "Stop Recording" : "Start Recording")) {
+                    if (recorder.is_open())
+                        stop_recording();
+                    else
+                        start_recording();
+                }
+                if (recorder.is_open()) {
+                    ImGui::SameLine();
+                    ImGui::Text("%s: %llu samples", recorder.get_path().c_str(), static_cast<unsigned long long>(recorder.get_record_count()));
+                }
+                if (!recorder.get_error().empty()) {
+                    ImGui::TextWrapped("Recording error (%s): %s", recorder.get_path().c_str(), recorder.get_error().c_str());
+                }
+            }
+        }
+
+        // Devices Window: attaches further devices (on other ports) next to the primary one
+        if (!replay_mode) {
+            ImGui::Begin("Devices");
+            ImGui::BeginDisabled(recorder.is_open()); // the merged recording's columns are fixed when it starts
+            static int attach_selection = -1;
+            if (attach_selection >= static_cast<int>(port_names.size())) {
+                attach_selection = -1; // the port list was gathered again
+            }
+            if (ImGui::BeginCombo("Port", attach_selection < 0 ? "<None>" : port_names[attach_selection].c_str())) {
+                for (size_t i = 0; i < port_names.size(); i++) {
+                    if (ImGui::Selectable(port_names[i].c_str(), attach_selection == static_cast<int>(i))) {
+                        attach_selection = static_cast<int>(i);
+                    }
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Attach") && attach_selection >= 0) {
+                attach_device(port_names[attach_selection], ring_capacity);
+            }
+
+            ImGui::BulletText("%s (primary): %s", PORT.c_str(), link_state_name(serial_engine.get_link_state()));
+            for (size_t d = 0; d < attached.size(); d++) {
+                Device& device = *attached[d].device;
+                ImGui::PushID(static_cast<int>(d));
+                ImGui::BulletText("%s (feed source %u): %s, %llu bytes, %llu lost, %.1f samples/s", device.get_port().c_str(),
+                                  static_cast<unsigned>(attached[d].feed_source), link_state_name(device.get_engine().get_link_state()),
+                                  static_cast<unsigned long long>(device.get_engine().get_bytes_received()),
+                                  static_cast<unsigned long long>(device.get_engine().get_frames_lost()), device.get_stage().get_sample_rate());
+                ImGui::SameLine();
+                if (ImGui::SmallButton("Detach")) {
+                    detach_device(d);
+                    ImGui::PopID();
+                    break;
+                }
+                ImGui::PopID();
+            }
+            ImGui::EndDisabled();
+            ImGui::Text("Merged at %.0f rows/s (recorded to merged_{date}_{time}.csv while recording)", BASE_MERGE_RATE);
+            ImGui::End();
+        }
+
+        // Sweep Window: steps the angle automatically and builds the polar (lift and drag against angle of attack)
+        if (!replay_mode) {
+            ImGui::Begin("Sweep");
+            ImGui::BeginDisabled(sweep.is_running());
+            ImGui::SliderScalar("Start", ImGuiDataType_S16, &sweep_settings.start, &MIN_ANGLE, &MAX_ANGLE);
+            ImGui::SliderScalar("Stop", ImGuiDataType_S16, &sweep_settings.stop, &MIN_ANGLE, &MAX_ANGLE);
+            const int16_t min_step = 1, max_step = MAX_ANGLE - MIN_ANGLE;
+            ImGui::SliderScalar("Step", ImGuiDataType_S16, &sweep_settings.step, &min_step, &max_step);
+            ImGui::InputDouble("Dwell (s, max per point)", &sweep_settings.dwell, 1.0, 5.0, "%.1f");
+            ImGui::InputInt("Samples per point", &sweep_settings.samples);
+            ImGui::InputDouble("Settle window (s)", &sweep_settings.settle_window, 0.1, 0.5, "%.2f");
+            ImGui::InputFloat("Settle tolerance", &sweep_settings.settle_tolerance, 0.01f, 0.1f, "%.3f");
+            ImGui::EndDisabled();
+
+            if (!sweep.is_running()) {
+                ImGui::BeginDisabled(controller.is_active());
+                if (ImGui::Button("Start Sweep") && serial_open && sweep.start(sweep_settings, serial_engine)) {
+                    rt_graph = true; // the sweep is driven by the incoming samples
+                }
+                ImGui::EndDisabled();
+            } else {
+                if (ImGui::Button("Stop Sweep")) {
+                    sweep.stop();
+                }
+                angle_rel = sweep.get_target();
+                update_angle();
             }
+            ImGui::SameLine();
+            ImGui::Text("%s: %d / %d points", sweep_state_name(sweep.get_state()), static_cast<int>(sweep.get_points().size()),
+                        static_cast<int>(sweep.get_point_count()));
+            if (!sweep.get_points().empty()) {
+                ImGui::SameLine();
+                if (ImGui::Button("Export CSV")) {
+                    export_polar();
+                }
+            }
+
+            // Polar with one standard deviation error bars
+            const std::vector<PolarPoint>& points = sweep.get_points();
+            if (ImPlot::BeginPlot("Polar", ImVec2(-1, 200))) {
+                ImPlot::SetupAxes("Angle of attack", "Force", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+                static std::vector<double> angles, lift, lift_error, drag, drag_error;
+                angles.clear(); lift.clear(); lift_error.clear(); drag.clear(); drag_error.clear();
+                for (const PolarPoint& p : points) {
+                    angles.push_back(p.angle);
+                    lift.push_back(p.lift_mean);
+                    lift_error.push_back(p.lift_stddev);
+                    drag.push_back(p.drag_mean);
+                    drag_error.push_back(p.drag_stddev);
+                }
+                const int count = static_cast<int>(points.size());
+                if (count > 0) {
+                    ImPlot::PlotErrorBars("Lift", angles.data(), lift.data(), lift_error.data(), count);
+                    ImPlot::PlotLine("Lift", angles.data(), lift.data(), count);
+                    ImPlot::PlotErrorBars("Drag", angles.data(), drag.data(), drag_error.data(), count);
+                    ImPlot::PlotLine("Drag", angles.data(), drag.data(), count);
+                }
+                ImPlot::EndPlot();
+            }
+            ImGui::End();
+        }
+
+        // Control Window: closed-loop control of the angle from the measured forces (runs on the I/O thread, see
+        //   controller.h), holding a target or tracing a profile loaded from a time_s,target CSV
+        if (!replay_mode) {
+            ImGui::Begin("Control");
+            static int control_mode = 0; // 0 holds a target, 1 traces a profile
+            static double control_target = 0.0;
+            static char profile_path[256] = "profile.csv";
+            static std::vector<ProfilePoint> profile;
+            const ControllerStatus status = controller.get_status();
+
+            if (ImGui::BeginCombo("Channel", control_channel_name(controller_settings.channel))) {
+                for (ControlChannel channel : {ControlChannel::Lift, ControlChannel::Drag}) {
+                    if (ImGui::Selectable(control_channel_name(channel), controller_settings.channel == channel)) {
+                        controller_settings.channel = channel;
+                    }
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::InputDouble("Kp (deg per unit)", &controller_settings.kp, 0.01, 0.1, "%.4f");
+            ImGui::InputDouble("Ki (deg per unit s)", &controller_settings.ki, 0.01, 0.1, "%.4f");
+            ImGui::InputDouble("Kd (deg s per unit)", &controller_settings.kd, 0.001, 0.01, "%.4f");
+            ImGui::InputDouble("Derivative cutoff (Hz)", &controller_settings.derivative_cutoff, 0.5, 5.0, "%.1f");
+            ImGui::SliderScalar("Min angle", ImGuiDataType_S16, &controller_settings.min_angle, &MIN_ANGLE, &MAX_ANGLE);
+            ImGui::SliderScalar("Max angle", ImGuiDataType_S16, &controller_settings.max_angle, &MIN_ANGLE, &MAX_ANGLE);
+            ImGui::InputDouble("Max rate (deg/s)", &controller_settings.max_rate, 5.0, 20.0, "%.1f");
+            ImGui::InputDouble("Update rate (Hz)", &controller_settings.rate, 5.0, 20.0, "%.0f");
+            ImGui::InputDouble("Max sample age (s)", &controller_settings.max_age, 0.01, 0.05, "%.3f");
+            if (ImGui::Button("Apply##control")) {
+                controller.configure(controller_settings);
+                controller_settings = controller.get_settings();
+            }
+
+            ImGui::RadioButton("Hold target", &control_mode, 0);
+            ImGui::SameLine();
+            ImGui::RadioButton("Trace profile", &control_mode, 1);
+            if (control_mode == 0) {
+                if (ImGui::InputDouble("Target", &control_target, 0.1, 1.0, "%.3f") && status.active && !status.tracing) {
+                    controller.set_target(control_target);
+                }
+            } else {
+                ImGui::InputText("Profile (CSV)", profile_path, sizeof(profile_path));
+                ImGui::SameLine();
+                if (ImGui::Button("Load##profile") && load_profile(profile_path, profile)) {
+                    std::cout << "Loaded a " << profile.back().t << " s profile of " << profile.size() << " points from " << profile_path << std::endl;
+                }
+                ImGui::Text("%zu points over %.1f s", profile.size(), profile.empty() ? 0.0 : profile.back().t);
+            }
+
+            if (!status.active) {
+                ImGui::BeginDisabled(!serial_engine.is_connected() || sweep.is_running() || (control_mode == 1 && profile.empty()));
+                if (ImGui::Button("Start Control")) {
+                    controller.configure(controller_settings);
+                    if (control_mode == 0) {
+                        controller.hold(control_target, serial_engine.get_angle());
+                    } else {
+                        controller.trace(profile, serial_engine.get_angle());
+                    }
+                    rt_graph = true; // control needs the stream
+                }
+                ImGui::EndDisabled();
+            } else {
+                if (ImGui::Button("Stop Control")) {
+                    controller.stop();
+                }
+                // The slider follows the controller's angle, so it picks up from there once control stops
+                angle_rel = static_cast<int16_t>(serial_engine.get_angle() - BASE_ANGLE);
+                update_angle();
+            }
+            ImGui::SameLine();
+            ImGui::Text("%s: %.1f s, %llu updates, %llu stale samples skipped", status.active ? (status.tracing ? "Tracing" : "Holding") : "Idle",
+                        status.elapsed, static_cast<unsigned long long>(status.updates), static_cast<unsigned long long>(status.stale));
+            ImGui::Text("Target %.3f, measured %.3f, error %.3f", status.target, status.measured, status.target - status.measured);
+            ImGui::Text("Angle %d (output %.2f, integral %.2f)", status.commanded, status.output, status.integral);
+            const Histogram& latency = serial_engine.get_control_latency();
+            ImGui::Text("Sense to actuate: median %llu us, 99%% %llu us, max %llu us (%llu angles sent)",
+                        static_cast<unsigned long long>(latency.percentile(50.0)), static_cast<unsigned long long>(latency.percentile(99.0)),
+                        static_cast<unsigned long long>(latency.max()), static_cast<unsigned long long>(latency.count()));
+
+            // Target and measurement of the recent updates
+            static std::vector<double> control_t, control_targets, control_measured;
+            static uint64_t plotted_updates = 0;
+            if (status.updates != plotted_updates) {
+                if (status.updates < plotted_updates || control_t.size() >= CONTROL_HISTORY) {
+                    const size_t keep = status.updates < plotted_updates ? 0 : CONTROL_HISTORY / 2;
+                    control_t.erase(control_t.begin(), control_t.end() - keep);
+                    control_targets.erase(control_targets.begin(), control_targets.end() - keep);
+                    control_measured.erase(control_measured.begin(), control_measured.end() - keep);
+                }
+                control_t.push_back(status.elapsed);
+                control_targets.push_back(status.target);
+                control_measured.push_back(status.measured);
+                plotted_updates = status.updates;
+            }
+            if (ImPlot::BeginPlot("Control", ImVec2(-1, 200))) {
+                ImPlot::SetupAxes("Time (s)", "Force", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+                const int count = static_cast<int>(control_t.size());
+                ImPlot::PlotLine("Target", control_t.data(), control_targets.data(), count);
+                ImPlot::PlotLine("Measured", control_t.data(), control_measured.data(), count);
+                ImPlot::EndPlot();
+            }
+            ImGui::End();
+        }
+
+        // Calibration Window: records the raw counts under known loads and fits the calibration to them by least squares
+        {
+            ImGui::Begin("Calibration");
+            static double load_v = 0.0, load_h = 0.0;
+            static int point_samples = 160;
+            static Calibration fitted;
+            static bool fit_valid = false;
+            static double residual_v = 0.0, residual_h = 0.0;
+            static std::string fit_error;
+
+            ImGui::TextWrapped("Place a known load, enter it below and record a point. Unloaded points and points loading "
+                               "each axis on its own let the fit separate offset, gain and cross-talk.");
+            ImGui::InputDouble("Vertical load", &load_v, 1.0, 10.0, "%.3f");
+            ImGui::InputDouble("Horizontal load", &load_h, 1.0, 10.0, "%.3f");
+            ImGui::InputInt("Samples per point", &point_samples);
+            if (!calibration_routine.is_measuring()) {
+                if (ImGui::Button("Record Point")) {
+                    calibration_routine.start_point(load_v, load_h, point_samples);
+                }
+            } else {
+                ImGui::ProgressBar(calibration_routine.get_progress(), ImVec2(200, 0));
+                ImGui::SameLine();
+                if (ImGui::Button("Cancel")) {
+                    calibration_routine.cancel_point();
+                }
+            }
+
+            const std::vector<CalibrationPoint>& points = calibration_routine.get_points();
+            if (ImGui::BeginTable("calibration_points", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+                ImGui::TableSetupColumn("Load V");
+                ImGui::TableSetupColumn("Load H");
+                ImGui::TableSetupColumn("Raw V");
+                ImGui::TableSetupColumn("Raw H");
+                ImGui::TableSetupColumn("");
+                ImGui::TableHeadersRow();
+                for (size_t i = 0; i < points.size(); i++) {
+                    ImGui::PushID(static_cast<int>(i));
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn(); ImGui::Text("%.3f", points[i].load_v);
+                    ImGui::TableNextColumn(); ImGui::Text("%.3f", points[i].load_h);
+                    ImGui::TableNextColumn(); ImGui::Text("%.1f", points[i].raw_v);
+                    ImGui::TableNextColumn(); ImGui::Text("%.1f", points[i].raw_h);
+                    ImGui::TableNextColumn();
+                    bool removed = ImGui::SmallButton("Remove");
+                    ImGui::PopID();
+                    if (removed) {
+                        calibration_routine.remove_point(i);
+                        break;
+                    }
+                }
+                ImGui::EndTable();
+            }
+
+            if (ImGui::Button("Fit")) {
+                fit_valid = fit_calibration(points, signal_stage.get_calibration(), fitted, residual_v, residual_h, fit_error);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Clear Points")) {
+                calibration_routine.clear();
+                fit_valid = false;
+            }
+            if (fit_valid) {
+                ImGui::Text("Factors: V %.3f, H %.3f counts/unit", fitted.factor_v, fitted.factor_h);
+                ImGui::Text("Offsets: V %.1f, H %.1f counts", fitted.offset_v, fitted.offset_h);
+                ImGui::Text("Cross-talk: H into V %.5f, V into H %.5f", fitted.crosstalk_vh, fitted.crosstalk_hv);
+                ImGui::Text("RMS error: V %.4f, H %.4f", residual_v, residual_h);
+                if (ImGui::Button("Apply")) {
+                    signal_stage.set_calibration(fitted);
+                }
+                ImGui::SameLine();
+                ImGui::Text("(\"Save\" in the Variables window writes it to %s)", CONFIG_PATH);
+            } else if (!fit_error.empty()) {
+                ImGui::Text("Fit failed: %s", fit_error.c_str());
+            }
+            ImGui::End();
+        }
+
+        // Replay Window (seeking clears the plots, which are then refilled from the new position)
+        if (replay_mode) {
+            ImGui::Begin("Replay");
+            float position = static_cast<float>(replay.get_position());
+            if (ImGui::SliderFloat("Position (s)", &position, 0.0f, static_cast<float>(replay.get_duration()), "%.1f")) {
+                replay.seek(position);
+                discard_samples(); // still from before the seek, they would arrive out of time order
+                angle_data.clear();
+                vertical_data.clear();
+                horizontal_data.clear();
+                vertical_filtered.clear();
+                horizontal_filtered.clear();
+                signal_stage.reset_stats();
+            }
+            float speed = replay.get_speed();
+            if (ImGui::SliderFloat("Speed", &speed, 1.0f, 100.0f, "%.0fx", ImGuiSliderFlags_Logarithmic)) {
+                replay.set_speed(speed);
+            }
+            bool paused = replay.is_paused();
+            if (ImGui::Checkbox("Paused", &paused)) {
+                replay.set_paused(paused);
+            }
+            const RecordingHeader& header = replay.get_header();
+            ImGui::Text("Port: %s", header.port);
+            ImGui::Text("Recorded calibration: V %.3f, H %.3f%s", header.calibration_v, header.calibration_h,
+                        header.version < 2 ? " (forces only, no raw counts)" : "");
+            if (ImGui::Button("Use Recorded Calibration")) {
+                signal_stage.set_calibration(replay.get_calibration());
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Load Config")) {
+                Calibration loaded = signal_stage.get_calibration();
+                if (load_config(loaded)) {
+                    signal_stage.set_calibration(loaded);
+                }
+            }
+            ImGui::TextWrapped("The Variables window edits, loads and saves the calibration applied to this run.");
+            ImGui::End();
         }
         
         // Rendering
@@ -558,12 +1424,21 @@ int main(int, char**)
         }
 
         SDL_GL_SwapWindow(window);
+        frame_time.record(static_cast<uint64_t>((host_time() - frame_start) * 1e6));
     }
 #ifdef __EMSCRIPTEN__
     EMSCRIPTEN_MAINLOOP_END;
 #endif
 
     // Cleanup
+    dump_metrics();
+    stop_recording();
+    replay.stop();
+    serial_engine.close();
+    attached.clear();
+    feed.close();
+    spectrum.stop();
+
     // [If using SDL_MAIN_USE_CALLBACKS: all code below would likely be your SDL_AppQuit() function]
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL3_Shutdown();
@@ -0,0 +1,148 @@
+#include "calibration.h"
+
+#include <algorithm>
+#include <cmath>
+
+// The two raw channels only count as independent if they are less correlated than this over the points (a load on one
+//   axis moves the other cell's counts too, through the cross-talk itself)
+const double MAX_CORRELATION2 = 0.99;
+
+namespace {
+
+// Affine map load = a_own * raw_own + a_other * raw_other + b of one channel
+struct ChannelFit {
+    double a_own;
+    double a_other;
+    double b;
+};
+
+// Fits one channel. own/other are the centered raw counts, load the centered loads, means the uncentered means.
+ChannelFit fit_channel (const std::vector<double>& own, const std::vector<double>& other, const std::vector<double>& load,
+                        double mean_own, double mean_other, double mean_load, ChannelFit fit) {
+    double s_oo = 0.0, s_xx = 0.0, s_ox = 0.0, s_oy = 0.0, s_xy = 0.0, s_yy = 0.0;
+    for (size_t i = 0; i < own.size(); i++) {
+        s_oo += own[i] * own[i];
+        s_xx += other[i] * other[i];
+        s_ox += own[i] * other[i];
+        s_oy += own[i] * load[i];
+        s_xy += other[i] * load[i];
+        s_yy += load[i] * load[i];
+    }
+
+    const bool loaded = s_yy > 0.0;
+    const bool independent = s_oo > 0.0 && s_xx > 0.0 && s_ox * s_ox < MAX_CORRELATION2 * s_oo * s_xx;
+    if (loaded && independent) {
+        // Both coefficients (2x2 normal equations)
+        const double determinant = s_oo * s_xx - s_ox * s_ox;
+        fit.a_own = (s_oy * s_xx - s_xy * s_ox) / determinant;
+        fit.a_other = (s_xy * s_oo - s_oy * s_ox) / determinant;
+    } else if (loaded && s_oo > 0.0) {
+        // Only the gain, keeping the cross-talk term
+        fit.a_own = (s_oy - fit.a_other * s_ox) / s_oo;
+    } else if (!loaded && s_xx > 0.0) {
+        // This channel's load never changed: the other channel's counts can only have leaked in through cross-talk
+        fit.a_other = (s_xy - fit.a_own * s_ox) / s_xx;
+    }
+    fit.b = mean_load - fit.a_own * mean_own - fit.a_other * mean_other;
+    return fit;
+}
+
+}
+
+bool fit_calibration (const std::vector<CalibrationPoint>& points, const Calibration& current, Calibration& result,
+                      double& residual_v, double& residual_h, std::string& error) {
+    if (points.empty()) {
+        error = "no calibration points";
+        return false;
+    }
+
+    // The calibration as an affine map: load = A * raw + b
+    ChannelFit fit_v = {1.0 / current.factor_v, current.crosstalk_vh / current.factor_h, 0.0};
+    ChannelFit fit_h = {1.0 / current.factor_h, current.crosstalk_hv / current.factor_v, 0.0};
+
+    const size_t n = points.size();
+    double mean_rv = 0.0, mean_rh = 0.0, mean_lv = 0.0, mean_lh = 0.0;
+    for (const CalibrationPoint& point : points) {
+        mean_rv += point.raw_v / n;
+        mean_rh += point.raw_h / n;
+        mean_lv += point.load_v / n;
+        mean_lh += point.load_h / n;
+    }
+    std::vector<double> rv(n), rh(n), lv(n), lh(n);
+    for (size_t i = 0; i < n; i++) {
+        rv[i] = points[i].raw_v - mean_rv;
+        rh[i] = points[i].raw_h - mean_rh;
+        lv[i] = points[i].load_v - mean_lv;
+        lh[i] = points[i].load_h - mean_lh;
+    }
+    fit_v = fit_channel(rv, rh, lv, mean_rv, mean_rh, mean_lv, fit_v);
+    fit_h = fit_channel(rh, rv, lh, mean_rh, mean_rv, mean_lh, fit_h);
+
+    if (fit_v.a_own == 0.0 || fit_h.a_own == 0.0 || !std::isfinite(fit_v.a_own) || !std::isfinite(fit_h.a_own)) {
+        error = "the loads do not change the raw counts";
+        return false;
+    }
+
+    // Back to factors and cross-talk (A = C * diag(1 / factor_v, 1 / factor_h)), and the offsets (A * offset + b = 0)
+    result.factor_v = 1.0 / fit_v.a_own;
+    result.factor_h = 1.0 / fit_h.a_own;
+    result.crosstalk_vh = fit_v.a_other * result.factor_h;
+    result.crosstalk_hv = fit_h.a_other * result.factor_v;
+    const double determinant = fit_v.a_own * fit_h.a_own - fit_v.a_other * fit_h.a_other;
+    if (determinant == 0.0 || !std::isfinite(determinant)) {
+        error = "the fitted cross-talk makes the channels inseparable";
+        return false;
+    }
+    result.offset_v = (-fit_v.b * fit_h.a_own + fit_h.b * fit_v.a_other) / determinant;
+    result.offset_h = (-fit_h.b * fit_v.a_own + fit_v.b * fit_h.a_other) / determinant;
+
+    double sum_v = 0.0, sum_h = 0.0;
+    for (const CalibrationPoint& point : points) {
+        float v, h;
+        result.apply(static_cast<float>(point.raw_v), static_cast<float>(point.raw_h), v, h);
+        sum_v += (v - point.load_v) * (v - point.load_v);
+        sum_h += (h - point.load_h) * (h - point.load_h);
+    }
+    residual_v = std::sqrt(sum_v / n);
+    residual_h = std::sqrt(sum_h / n);
+    return true;
+}
+
+void CalibrationRoutine::start_point(double v, double h, int samples) {
+    load_v = v;
+    load_h = h;
+    requested = std::max(samples, 1);
+    remaining = requested;
+    raw_v.reset();
+    raw_h.reset();
+}
+
+void CalibrationRoutine::cancel_point() {
+    remaining = 0;
+}
+
+void CalibrationRoutine::update(const Sample& sample) {
+    if (remaining <= 0) {
+        return;
+    }
+    raw_v.add(sample.raw_v);
+    raw_h.add(sample.raw_h);
+    if (--remaining == 0) {
+        points.push_back({load_v, load_h, raw_v.get_mean(), raw_h.get_mean(), raw_v.get_count()});
+    }
+}
+
+float CalibrationRoutine::get_progress() const {
+    return requested > 0 ? 1.0f - static_cast<float>(remaining) / requested : 0.0f;
+}
+
+void CalibrationRoutine::remove_point(size_t index) {
+    if (index < points.size()) {
+        points.erase(points.begin() + index);
+    }
+}
+
+void CalibrationRoutine::clear() {
+    points.clear();
+    remaining = 0;
+}
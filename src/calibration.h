@@ -0,0 +1,85 @@
+// Load Cell Calibration
+//   The Arduino streams raw HX711 counts; the host turns them into forces. Keeping the raw counts (live and in
+//   recordings) means a run can be recalibrated after the fact instead of re-run.
+//
+// For raw counts (r_v, r_h):
+//   u_v = (r_v - offset_v) / factor_v          u_h = (r_h - offset_h) / factor_h
+//   v   = u_v + crosstalk_vh * u_h             h   = crosstalk_hv * u_v + u_h
+// factor_v/factor_h are counts per unit, like the calibration factors the sketch used to apply (HX711_ADC's
+// calFactor), and the cross-talk terms correct for the share of one load that each cell also sees.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sample.h"
+#include "stats.h"
+
+// Channel masks, e.g. for taring
+const uint8_t CHANNEL_V = 0x01;
+const uint8_t CHANNEL_H = 0x02;
+
+struct Calibration {
+    double factor_v = 1.0;
+    double factor_h = 1.0;
+    double offset_v = 0.0;     // raw counts at zero load
+    double offset_h = 0.0;
+    double crosstalk_vh = 0.0; // horizontal load seen by the vertical channel, removed from v
+    double crosstalk_hv = 0.0;
+
+    void apply(float raw_v, float raw_h, float& v, float& h) const {
+        const double u_v = (raw_v - offset_v) / factor_v;
+        const double u_h = (raw_h - offset_h) / factor_h;
+        v = static_cast<float>(u_v + crosstalk_vh * u_h);
+        h = static_cast<float>(crosstalk_hv * u_v + u_h);
+    }
+
+    // Fills sample.v/h from sample.raw_v/raw_h
+    void apply(Sample& sample) const {
+        apply(sample.raw_v, sample.raw_h, sample.v, sample.h);
+    }
+};
+
+static_assert(sizeof(Calibration) == 48, "Calibration is stored in recording headers");
+
+// A known load and the mean raw counts measured under it
+struct CalibrationPoint {
+    double load_v;
+    double load_h;
+    double raw_v;
+    double raw_h;
+    uint64_t samples;
+};
+
+// Solves for the calibration that maps the points' raw counts onto their loads by least squares, starting from
+//   current. Each channel's factor is fitted if its loads vary, its cross-talk term if the other channel's counts vary
+//   independently of its own, and its offset always; whatever the points cannot determine is kept from current.
+//   residual_v/residual_h are the RMS errors of the fit at the points. Returns false (and sets error) without points.
+bool fit_calibration (const std::vector<CalibrationPoint>& points, const Calibration& current, Calibration& result,
+                      double& residual_v, double& residual_h, std::string& error);
+
+// Guided calibration: the user places a known load, then the routine averages the raw counts of the next samples
+//   into a point. Fed with every sample from the consumer thread, like Sweep.
+class CalibrationRoutine {
+public:
+    void start_point(double load_v, double load_h, int samples);
+    void cancel_point();
+    void update(const Sample& sample);
+
+    bool is_measuring() const { return remaining > 0; }
+    float get_progress() const;
+    const std::vector<CalibrationPoint>& get_points() const { return points; }
+    void remove_point(size_t index);
+    void clear();
+
+private:
+    std::vector<CalibrationPoint> points;
+    double load_v = 0.0;
+    double load_h = 0.0;
+    int requested = 0;
+    int remaining = 0;
+    RunningStats raw_v, raw_h;
+};
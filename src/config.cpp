@@ -0,0 +1,56 @@
+#include "config.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+bool save_config (const Calibration& calibration, const std::string& path) {
+    std::ofstream stream{path};
+    if (!stream) {
+        std::cerr << "Error: the config could not be opened or written to." << std::endl;
+        return false;
+    }
+    stream << std::setprecision(10);
+    stream << calibration.factor_v << std::endl;
+    stream << calibration.factor_h << std::endl;
+    stream << calibration.offset_v << std::endl;
+    stream << calibration.offset_h << std::endl;
+    stream << calibration.crosstalk_vh << std::endl;
+    stream << calibration.crosstalk_hv << std::endl;
+    return true;
+}
+
+bool load_config (Calibration& calibration, const std::string& path) {
+    std::vector<std::string> results;
+    std::ifstream stream{path};
+    if (!stream) {
+        std::cerr << "Error: the config could not be opened or read from." << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (!line.empty()) {
+            results.push_back(line);
+        }
+    }
+    try {
+        if (results.size() < 2) {
+            throw std::invalid_argument("missing values");
+        }
+        Calibration loaded;
+        double* values[] = {&loaded.factor_v, &loaded.factor_h, &loaded.offset_v, &loaded.offset_h,
+                            &loaded.crosstalk_vh, &loaded.crosstalk_hv};
+        for (size_t i = 0; i < results.size() && i < sizeof(values) / sizeof(values[0]); i++) {
+            *values[i] = std::stod(results[i]);
+        }
+        if (loaded.factor_v == 0.0 || loaded.factor_h == 0.0) {
+            throw std::invalid_argument("zero calibration factor");
+        }
+        calibration = loaded;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: the config " << path << " is malformed (" << e.what() << ")." << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+// Shared Settings & Config File
+//   Defaults used by every wind tunnel program, and the config.txt that stores the calibration.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "calibration.h"
+
+// Angle Variables
+const int16_t BASE_ANGLE = 85;
+
+// Calibration Variables (counts per unit)
+const float BASE_CALIBRATION_V = 714.0f;
+const float BASE_CALIBRATION_H = 116.0f;
+
+// Calibration before anything is loaded or tared
+inline Calibration base_calibration () {
+    Calibration calibration;
+    calibration.factor_v = BASE_CALIBRATION_V;
+    calibration.factor_h = BASE_CALIBRATION_H;
+    return calibration;
+}
+
+// Serial Variables
+const unsigned long BAUD = 115200;
+const unsigned long MAX_BAUD = 1000000; // fastest rate negotiated after connecting (BAUD: never faster)
+const char* const DEFAULT_PORT = "/dev/cu.usbmodem11401"; // port for arduino
+
+const char* const CONFIG_PATH = "config.txt";
+
+// config.txt holds one value per line: the vertical and horizontal calibration factors, then the vertical and
+//   horizontal offsets and the two cross-talk terms (see calibration.h). Files with only the two factors (as written
+//   before the host applied the calibration) still load, with zero offsets and cross-talk.
+//   Both return false (and leave the calibration untouched on load) if the file can't be used.
+bool save_config (const Calibration& calibration, const std::string& path = CONFIG_PATH);
+bool load_config (Calibration& calibration, const std::string& path = CONFIG_PATH);
@@ -0,0 +1,219 @@
+#include "controller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "config.h"
+
+const double PI = 3.14159265358979323846;
+const double MAX_CONTROL_GAP = 0.5; // seconds between updates before the derivative restarts
+
+const char* control_channel_name (ControlChannel channel) {
+    switch (channel) {
+        case ControlChannel::Lift: return "Lift (vertical)";
+        case ControlChannel::Drag: return "Drag (horizontal)";
+    }
+    return "Unknown";
+}
+
+bool load_profile (const std::string& path, std::vector<ProfilePoint>& profile) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: could not open " << path << " for reading." << std::endl;
+        return false;
+    }
+    std::vector<ProfilePoint> points;
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream fields(line);
+        ProfilePoint point;
+        if (!(fields >> point.t >> point.target)) {
+            if (number == 1) {
+                continue; // header
+            }
+            std::cerr << "Error: " << path << " line " << number << " is not time_s,target." << std::endl;
+            return false;
+        }
+        if (!points.empty() && point.t <= points.back().t) {
+            std::cerr << "Error: " << path << " line " << number << " does not come after the previous point." << std::endl;
+            return false;
+        }
+        points.push_back(point);
+    }
+    if (points.empty()) {
+        std::cerr << "Error: " << path << " holds no profile points." << std::endl;
+        return false;
+    }
+    profile = std::move(points);
+    return true;
+}
+
+void ForceController::configure(const ControllerSettings& new_settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    settings = new_settings;
+    if (settings.min_angle > settings.max_angle) {
+        std::swap(settings.min_angle, settings.max_angle);
+    }
+    settings.max_rate = std::max(0.1, settings.max_rate);
+    settings.rate = std::max(1.0, settings.rate);
+    settings.derivative_cutoff = std::max(0.1, settings.derivative_cutoff);
+    settings.max_age = std::max(0.001, settings.max_age);
+}
+
+ControllerSettings ForceController::get_settings() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return settings;
+}
+
+// Resets the loop so the output starts at the flap's current angle (called with the mutex held)
+void ForceController::start(int16_t current_angle) {
+    const double angle = std::clamp<double>(current_angle - BASE_ANGLE, settings.min_angle, settings.max_angle);
+    const uint64_t stale = status.stale;
+    status = ControllerStatus();
+    status.active = true;
+    status.stale = stale;
+    status.output = angle;
+    status.integral = angle;
+    status.commanded = static_cast<int16_t>(current_angle - BASE_ANGLE);
+    start_t = -1.0;
+    last_update = -1.0;
+    derivative = 0.0;
+}
+
+void ForceController::hold(double target, int16_t current_angle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    start(current_angle);
+    status.target = target;
+    std::cout << "Control: holding " << control_channel_name(settings.channel) << " at " << target << std::endl;
+}
+
+void ForceController::set_target(double target) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!status.tracing) {
+        status.target = target;
+    }
+}
+
+bool ForceController::trace(std::vector<ProfilePoint> points, int16_t current_angle) {
+    if (points.empty()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    profile = std::move(points);
+    start(current_angle);
+    status.tracing = true;
+    status.target = profile.front().target;
+    std::cout << "Control: tracing a " << profile.back().t << " s profile of " << control_channel_name(settings.channel) << std::endl;
+    return true;
+}
+
+void ForceController::stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (status.active) {
+        status.active = false;
+        std::cout << "Control: stopped after " << status.elapsed << " s" << std::endl;
+    }
+}
+
+bool ForceController::is_active() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return status.active;
+}
+
+ControllerStatus ForceController::get_status() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return status;
+}
+
+// Linear interpolation between the profile's points, holding the first target before it starts
+double ForceController::profile_target(double elapsed) const {
+    auto next = std::upper_bound(profile.begin(), profile.end(), elapsed,
+                                 [](double t, const ProfilePoint& point) { return t < point.t; });
+    if (next == profile.begin()) {
+        return profile.front().target;
+    }
+    if (next == profile.end()) {
+        return profile.back().target;
+    }
+    const ProfilePoint& previous = *(next - 1);
+    const double fraction = (elapsed - previous.t) / (next->t - previous.t);
+    return previous.target + fraction * (next->target - previous.target);
+}
+
+void ForceController::update(const Sample* block, size_t count, SerialEngine& engine) {
+    if (count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!status.active) {
+        return;
+    }
+    // Only the newest sample matters: the older ones of the block have been superseded
+    const Sample& sample = block[count - 1];
+    if (host_time() - sample.t > settings.max_age) {
+        status.stale++;
+        return;
+    }
+    const double measured = settings.channel == ControlChannel::Lift ? sample.v_filtered : sample.h_filtered;
+    if (!std::isfinite(measured)) {
+        return; // never turns a diverged filter into a servo angle
+    }
+    if (start_t < 0.0) {
+        start_t = sample.t;
+    }
+    double dt = last_update < 0.0 ? 0.0 : sample.t - last_update;
+    if (last_update >= 0.0 && dt >= 0.0 && dt < 1.0 / settings.rate) {
+        return;
+    }
+    const double elapsed = sample.t - start_t;
+    if (status.tracing && elapsed > profile.back().t) {
+        status.active = false;
+        std::cout << "Control: profile finished after " << elapsed << " s" << std::endl;
+        return;
+    }
+
+    const double target = status.tracing ? profile_target(elapsed) : status.target;
+    const double error = target - measured;
+
+    // Derivative of the measurement, through a first-order low-pass. Restarted after a gap (or a first update).
+    if (dt <= 0.0 || dt > MAX_CONTROL_GAP) {
+        dt = 0.0;
+        derivative = 0.0;
+    } else {
+        const double alpha = dt / (dt + 1.0 / (2.0 * PI * settings.derivative_cutoff));
+        derivative += alpha * ((measured - last_measured) / dt - derivative);
+    }
+
+    const double lo = settings.min_angle, hi = settings.max_angle;
+    const double integrating = settings.ki * error * dt;
+    double integral = status.integral + integrating;
+    const double unlimited = settings.kp * error + integral - settings.kd * derivative;
+    const double step = settings.max_rate * (dt > 0.0 ? dt : 1.0 / settings.rate);
+    const double output = std::clamp(std::clamp(unlimited, lo, hi), status.output - step, status.output + step);
+    // Anti-windup: the integral holds while a limit keeps the output from following it
+    if ((unlimited > output && integrating > 0.0) || (unlimited < output && integrating < 0.0)) {
+        integral = status.integral;
+    }
+
+    status.integral = std::clamp(integral, lo, hi);
+    status.output = output;
+    status.target = target;
+    status.measured = measured;
+    status.elapsed = elapsed;
+    status.updates++;
+    last_update = sample.t;
+    last_measured = measured;
+
+    const int16_t commanded = static_cast<int16_t>(std::lround(output));
+    if (commanded != status.commanded) {
+        status.commanded = commanded;
+        engine.send_angle(static_cast<int16_t>(BASE_ANGLE + commanded), sample.t);
+    }
+}
@@ -0,0 +1,100 @@
+// Closed-Loop Force Control
+//   Drives the servo from the measured forces: a PID controller moves the flap to hold one channel (lift or drag) at
+//   a target, or to make it trace a profile of targets over time. It runs on the acquisition thread (the serial
+//   engine's I/O thread) right after the signal stage, and its angles go straight into the engine's command queue,
+//   so a new angle is written on the very next I/O cycle instead of waiting for the render loop.
+//
+// Each update (at most `rate` per second, on the newest sample of a block) works in degrees relative to BASE_ANGLE:
+// - P acts on the error, D on the measurement (so a step in the target gives no kick), low-pass filtered;
+// - I starts at the angle the flap had when control started (bumpless), and only integrates while the output is not
+//   saturated in the direction of the error (anti-windup); it never leaves the angle limits either;
+// - the output is clamped to [min_angle, max_angle] and moves at most max_rate degrees per second.
+// The servo takes whole degrees, so an angle is only sent when the rounded output changes. A sample older than
+// max_age by the time it is processed (e.g. a backlog after a stall) is not acted on, so the servo never follows
+// stale data, and a gap in the samples restarts the derivative. The sense-to-actuate latency (from the Arduino
+// measuring the sample to the angle being written to the port) is recorded by SerialEngine::get_control_latency().
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sample.h"
+#include "serial_engine.h"
+
+enum class ControlChannel { Lift, Drag }; // vertical or horizontal (filtered) reading
+
+const char* control_channel_name (ControlChannel channel);
+
+struct ControllerSettings {
+    ControlChannel channel = ControlChannel::Lift;
+    double kp = 0.1;                // degrees per unit of error
+    double ki = 0.5;                // degrees per unit of error and second
+    double kd = 0.0;                // degrees per unit per second
+    double derivative_cutoff = 5.0; // Hz, low-pass on the derivative
+    int16_t min_angle = -30;        // relative to BASE_ANGLE
+    int16_t max_angle = 30;
+    double max_rate = 60.0;         // degrees per second
+    double rate = 50.0;             // updates per second
+    double max_age = 0.1;           // seconds
+};
+
+// A profile target: the controlled channel should read target at t seconds after the profile started
+struct ProfilePoint {
+    double t;
+    double target;
+};
+
+struct ControllerStatus {
+    bool active = false;
+    bool tracing = false;       // following a profile (false: holding a fixed target)
+    double elapsed = 0.0;       // seconds since control started (sample time)
+    double target = 0.0;
+    double measured = 0.0;
+    double output = 0.0;        // continuous angle (relative)
+    double integral = 0.0;      // I term, in degrees
+    int16_t commanded = 0;      // last angle sent (relative)
+    uint64_t updates = 0;
+    uint64_t stale = 0;         // samples skipped for being older than max_age
+};
+
+// Reads a profile from a CSV of time_s,target rows (a header line is skipped). Times must increase.
+bool load_profile (const std::string& path, std::vector<ProfilePoint>& profile);
+
+class ForceController {
+public:
+    // Thread-safe; the gains and limits apply from the next update (the integral is kept)
+    void configure(const ControllerSettings& settings);
+    ControllerSettings get_settings() const;
+
+    // Starts holding target, from the flap's current absolute angle
+    void hold(double target, int16_t current_angle);
+    // Changes the target while holding
+    void set_target(double target);
+    // Starts tracing profile from its first point; control stops (holding the last angle) after its last point
+    bool trace(std::vector<ProfilePoint> profile, int16_t current_angle);
+    void stop();
+    bool is_active() const;
+
+    // Acquisition thread: advances with a processed block and sends at most one angle through engine
+    void update(const Sample* block, size_t count, SerialEngine& engine);
+
+    ControllerStatus get_status() const;
+
+private:
+    void start(int16_t current_angle);
+    double profile_target(double elapsed) const;
+
+    mutable std::mutex mutex;
+    ControllerSettings settings;
+    std::vector<ProfilePoint> profile;
+    ControllerStatus status;
+
+    // State of the loop (under the mutex, like everything else: it is taken once per block)
+    double start_t = -1.0;       // time of the first sample under control (-1 until it arrives)
+    double last_update = -1.0;   // time of the sample of the last update
+    double last_measured = 0.0;
+    double derivative = 0.0;     // filtered d(measured)/dt
+};
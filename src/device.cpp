@@ -0,0 +1,53 @@
+#include "device.h"
+
+#include <iostream>
+
+Device::Device(size_t ring_capacity) : ring(ring_capacity) {
+    engine.set_frame_handler([this](const WtFrame& frame) { handle_frame(frame); });
+    engine.set_chunk_handler([this]() { handle_chunk(); });
+}
+
+Device::~Device() {
+    close();
+}
+
+bool Device::open(const std::string& port_name, unsigned long baud, uint16_t rate) {
+    port = port_name;
+    if (!engine.open(port, baud)) {
+        std::cerr << "Error: serial port " << port << " did not open." << std::endl;
+        return false;
+    }
+    std::cout << "Device attached on port " << port << std::endl;
+    engine.start_stream(rate);
+    stage.tare(CHANNEL_V | CHANNEL_H); // zeroes the load cells, like the sketch used to on boot
+    return true;
+}
+
+void Device::close() {
+    engine.close();
+    acquired.clear();
+}
+
+void Device::handle_frame(const WtFrame& frame) {
+    Sample sample;
+    if (sample_from_frame(frame, engine.get_clock(), host_time(), sample)) {
+        acquired.push_back(sample);
+    }
+}
+
+void Device::handle_chunk() {
+    if (acquired.empty()) {
+        return;
+    }
+    stage.process(acquired.data(), acquired.size());
+    for (const Sample& sample : acquired) {
+        ring.push(sample);
+    }
+    if (feed) {
+        feed->publish(acquired.data(), acquired.size(), feed_source);
+    }
+    acquired.clear();
+    if (data_handler) {
+        data_handler();
+    }
+}
@@ -0,0 +1,56 @@
+// Acquisition Device
+//   One attached Arduino: its serial engine (and therefore its own I/O thread), signal stage and sample ring.
+//   Devices share nothing while acquiring, so each one runs on its own core and adding a device never slows the others;
+//   the render loop drains every device's ring and merges them (see merger.h).
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sample.h"
+#include "sample_feed.h"
+#include "serial_engine.h"
+#include "signal_stage.h"
+#include "spsc_ring.h"
+
+class Device {
+public:
+    explicit Device(size_t ring_capacity);
+    ~Device();
+
+    Device(const Device&) = delete;
+    Device& operator=(const Device&) = delete;
+
+    // Opens the port and starts streaming at rate. Throws serial::IOException like SerialEngine::open. If the link
+    //   drops, the device's I/O thread waits for the Arduino to come back on the same port and resumes streaming.
+    bool open(const std::string& port, unsigned long baud, uint16_t rate);
+    void close();
+    bool is_open() const { return engine.is_open(); }
+
+    // Called on the device's I/O thread after each block of samples was pushed to the ring. Must be set before open().
+    void set_data_handler(std::function<void()> handler) { data_handler = std::move(handler); }
+    // Also publishes every processed sample to feed, as source. Must be set before open().
+    void set_feed(FeedPublisher* publisher, uint16_t source) { feed = publisher; feed_source = source; }
+
+    const std::string& get_port() const { return port; }
+    SerialEngine& get_engine() { return engine; }
+    SignalStage& get_stage() { return stage; }
+    SpscRing<Sample>& get_ring() { return ring; }
+
+private:
+    void handle_frame(const WtFrame& frame);
+    void handle_chunk();
+
+    std::string port;
+    SerialEngine engine;
+    SignalStage stage;
+    SpscRing<Sample> ring;
+    std::vector<Sample> acquired; // I/O thread only
+    std::function<void()> data_handler;
+    FeedPublisher* feed = nullptr;
+    uint16_t feed_source = 0;
+};
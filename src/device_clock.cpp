@@ -0,0 +1,91 @@
+#include "device_clock.h"
+
+#include <algorithm>
+#include <iostream>
+
+void DeviceClock::reset() {
+    started = false;
+    minima.clear();
+    fit_slope = 0.0;
+    drift_estimate = 0.0;
+}
+
+double DeviceClock::map(uint32_t raw, double received) {
+    if (started) {
+        const uint32_t elapsed = raw - last_raw; // modulo 2^32, so a wrap still moves forward
+        if (elapsed > 0x80000000u) {
+            // Went backwards: the device restarted, so the old mapping no longer applies
+            std::cout << "Device clock restarted, resynchronizing" << std::endl;
+            started = false;
+            minima.clear();
+            fit_slope = 0.0;
+        } else {
+            device_us += elapsed;
+        }
+    }
+    if (!started) {
+        started = true;
+        device_us = raw;
+        window_start = raw * 1e-6;
+        window = {window_start, received - window_start};
+        fit_center = window.device;
+        fit_offset = window.offset;
+    }
+    last_raw = raw;
+
+    const double device = device_us * 1e-6;
+    const double offset = received - device;
+
+    // Closes the window once it spans CLOCK_WINDOW of device time, then refits
+    if (device - window_start >= CLOCK_WINDOW) {
+        minima.push_back(window);
+        if (minima.size() > CLOCK_WINDOWS) {
+            minima.pop_front();
+        }
+        fit();
+        window_start = device;
+        window = {device, offset};
+    } else if (offset < window.offset) {
+        window = {device, offset};
+    }
+
+    // Until there are two windows to fit, the smallest offset seen so far is used as is
+    double estimate = fit_offset + fit_slope * (device - fit_center);
+    if (minima.size() < 2) {
+        estimate = std::min(minima.empty() ? window.offset : fit_offset, window.offset);
+    }
+    offset_estimate = estimate;
+
+    double mapped = std::min(device + estimate, received);
+    mapped = std::max(mapped, last_mapped);
+    last_mapped = mapped;
+    return mapped;
+}
+
+void DeviceClock::fit() {
+    if (minima.size() < 2) {
+        fit_center = minima.back().device;
+        fit_offset = minima.back().offset;
+        fit_slope = 0.0;
+        return;
+    }
+
+    // Least squares line through the window minima, centered for precision
+    double mean_device = 0.0, mean_offset = 0.0;
+    for (const Minimum& m : minima) {
+        mean_device += m.device;
+        mean_offset += m.offset;
+    }
+    mean_device /= minima.size();
+    mean_offset /= minima.size();
+
+    double covariance = 0.0, variance = 0.0;
+    for (const Minimum& m : minima) {
+        covariance += (m.device - mean_device) * (m.offset - mean_offset);
+        variance += (m.device - mean_device) * (m.device - mean_device);
+    }
+    fit_center = mean_device;
+    fit_offset = mean_offset;
+    fit_slope = variance > 0.0 ? covariance / variance : 0.0;
+    drift_estimate = fit_slope * 1e6;
+}
@@ -0,0 +1,54 @@
+// Device Clock
+//   Maps the Arduino's micros() timestamps onto the host clock (host_time() seconds, double precision).
+//   micros() wraps every ~71.6 minutes, so it is unwrapped into 64 bits first. A frame can only arrive after it was
+//   stamped, so the smallest (host - device) difference seen in each CLOCK_WINDOW is the best estimate of the clock
+//   offset; a line fitted through the last CLOCK_WINDOWS minima also tracks the drift between the two crystals.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+const double CLOCK_WINDOW = 1.0;  // seconds of device time per offset estimate
+const size_t CLOCK_WINDOWS = 60;  // number of estimates the drift is fitted over
+
+class DeviceClock {
+public:
+    // Forgets the current mapping (e.g. after reconnecting, the device may have restarted)
+    void reset();
+
+    // Host time at which the device stamped device_us, for a frame received at host time received.
+    //   Mapped times never decrease and are never later than received. Not thread-safe (call from one thread).
+    double map(uint32_t device_us, double received);
+
+    // Current estimates (readable from any thread)
+    double get_offset() const { return offset_estimate; } // host - device seconds
+    double get_drift_ppm() const { return drift_estimate; }
+
+private:
+    struct Minimum {
+        double device; // device seconds
+        double offset; // smallest host - device seconds in the window
+    };
+
+    void fit();
+
+    bool started = false;
+    uint32_t last_raw = 0;
+    uint64_t device_us = 0; // unwrapped
+
+    double window_start = 0.0;
+    Minimum window{0.0, 0.0};
+    std::deque<Minimum> minima;
+
+    // offset(device) = fit_offset + fit_slope * (device - fit_center)
+    double fit_center = 0.0;
+    double fit_offset = 0.0;
+    double fit_slope = 0.0;
+    double last_mapped = 0.0; // kept across resets, so times stay ordered after a reconnect
+
+    std::atomic<double> offset_estimate{0.0};
+    std::atomic<double> drift_estimate{0.0};
+};
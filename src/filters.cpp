@@ -0,0 +1,114 @@
+#include "filters.h"
+
+#include <algorithm>
+#include <cmath>
+
+const double PI = 3.14159265358979323846;
+
+Biquad Biquad::lowpass(double sample_rate, double cutoff, double q) {
+    const double w0 = 2.0 * PI * cutoff / sample_rate;
+    const double alpha = std::sin(w0) / (2.0 * q);
+    const double cos_w0 = std::cos(w0);
+    const double a0 = 1.0 + alpha;
+
+    Biquad filter;
+    filter.b0 = (1.0 - cos_w0) / 2.0 / a0;
+    filter.b1 = (1.0 - cos_w0) / a0;
+    filter.b2 = filter.b0;
+    filter.a1 = -2.0 * cos_w0 / a0;
+    filter.a2 = (1.0 - alpha) / a0;
+    return filter;
+}
+
+Biquad Biquad::notch(double sample_rate, double center, double q) {
+    const double w0 = 2.0 * PI * center / sample_rate;
+    const double alpha = std::sin(w0) / (2.0 * q);
+    const double cos_w0 = std::cos(w0);
+    const double a0 = 1.0 + alpha;
+
+    Biquad filter;
+    filter.b0 = 1.0 / a0;
+    filter.b1 = -2.0 * cos_w0 / a0;
+    filter.b2 = filter.b0;
+    filter.a1 = filter.b1;
+    filter.a2 = (1.0 - alpha) / a0;
+    return filter;
+}
+
+void Biquad::process(const float* input, float* output, size_t count) {
+    // Local copies keep the state in registers for the whole block
+    double s1 = z1, s2 = z2;
+    for (size_t i = 0; i < count; i++) {
+        const double x = input[i];
+        const double y = b0 * x + s1;
+        s1 = b1 * x - a1 * y + s2;
+        s2 = b2 * x - a2 * y;
+        output[i] = static_cast<float>(y);
+    }
+    z1 = s1;
+    z2 = s2;
+}
+
+FirFilter::FirFilter(std::vector<float> coefficients) : taps(std::move(coefficients)) {
+    std::reverse(taps.begin(), taps.end());
+    reset();
+}
+
+FirFilter FirFilter::lowpass(double sample_rate, double cutoff, size_t count) {
+    count = std::max<size_t>(count, 3) | 1; // odd length, so the filter has an integer group delay; 3+ so the window is defined
+    const double fc = cutoff / sample_rate;
+    const double middle = (count - 1) / 2.0;
+    std::vector<float> coefficients(count);
+    double sum = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        const double n = i - middle;
+        const double sinc = n == 0.0 ? 2.0 * fc : std::sin(2.0 * PI * fc * n) / (PI * n);
+        const double window = 0.54 - 0.46 * std::cos(2.0 * PI * i / (count - 1));
+        coefficients[i] = static_cast<float>(sinc * window);
+        sum += coefficients[i];
+    }
+    for (float& c : coefficients) {
+        c = static_cast<float>(c / sum); // unity gain at DC
+    }
+    return FirFilter(std::move(coefficients));
+}
+
+void FirFilter::reset() {
+    buffer.assign(taps.empty() ? 0 : taps.size() - 1, 0.0f);
+}
+
+void FirFilter::process(const float* input, float* output, size_t count) {
+    if (taps.empty()) {
+        std::copy(input, input + count, output);
+        return;
+    }
+    const size_t history = taps.size() - 1;
+    buffer.resize(history + count);
+    std::copy(input, input + count, buffer.begin() + history);
+
+    const float* t = taps.data();
+    const size_t n = taps.size();
+    for (size_t i = 0; i < count; i++) {
+        // Eight independent partial sums, so the loop vectorizes without reordering a single floating point sum
+        const float* x = buffer.data() + i;
+        float partial[8] = {};
+        size_t k = 0;
+        for (; k + 8 <= n; k += 8) {
+            for (size_t j = 0; j < 8; j++) {
+                partial[j] += t[k + j] * x[k + j];
+            }
+        }
+        float sum = 0.0f;
+        for (; k < n; k++) {
+            sum += t[k] * x[k];
+        }
+        for (size_t j = 0; j < 8; j++) {
+            sum += partial[j];
+        }
+        output[i] = sum;
+    }
+
+    // Keeps the last taps - 1 inputs for the next block
+    std::copy(buffer.end() - history, buffer.end(), buffer.begin());
+    buffer.resize(history);
+}
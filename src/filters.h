@@ -0,0 +1,41 @@
+// Digital Filters
+//   Block-based filters for the acquisition path: each call processes a whole block of samples of one channel,
+//   keeping the filter state between blocks, so a channel is filtered seamlessly however the blocks are split.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Second-order IIR section (transposed direct form II, double precision state). Coefficients follow the
+//   RBJ audio EQ cookbook and are normalized so a0 = 1.
+class Biquad {
+public:
+    static Biquad lowpass(double sample_rate, double cutoff, double q = 0.7071);
+    static Biquad notch(double sample_rate, double center, double q = 5.0);
+
+    void process(const float* input, float* output, size_t count);
+    void reset() { z1 = z2 = 0.0; }
+
+private:
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    double z1 = 0.0, z2 = 0.0;
+};
+
+// Finite impulse response filter. The previous taps - 1 inputs are kept in front of each block, so every output
+//   is a dot product over contiguous memory that the compiler can vectorize.
+class FirFilter {
+public:
+    FirFilter() = default;
+    explicit FirFilter(std::vector<float> taps);
+    // Windowed-sinc (Hamming) low-pass with an odd number of taps
+    static FirFilter lowpass(double sample_rate, double cutoff, size_t taps);
+
+    void process(const float* input, float* output, size_t count);
+    void reset();
+    size_t size() const { return taps.size(); }
+
+private:
+    std::vector<float> taps;   // stored reversed, so the inner loop walks both arrays forwards
+    std::vector<float> buffer; // [taps - 1 previous inputs][current block]
+};
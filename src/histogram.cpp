@@ -0,0 +1,85 @@
+#include "histogram.h"
+
+#include <iomanip>
+
+Histogram::Histogram(std::string name, std::string unit) : name(std::move(name)), unit(std::move(unit)) {
+    reset();
+}
+
+size_t Histogram::bucket_of(uint64_t value) {
+    if (value < (uint64_t(1) << SUB_BUCKET_BITS)) {
+        return static_cast<size_t>(value);
+    }
+    // Shift so the value keeps its top SUB_BUCKET_BITS bits: sub_bucket is in [64, 128)
+    const int magnitude = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS + 1;
+    const uint64_t sub_bucket = value >> magnitude;
+    return static_cast<size_t>(magnitude) * HALF_SUB_BUCKETS + static_cast<size_t>(sub_bucket);
+}
+
+uint64_t Histogram::highest_value_of(size_t bucket) {
+    if (bucket < (size_t(1) << SUB_BUCKET_BITS)) {
+        return bucket;
+    }
+    const size_t magnitude = bucket / HALF_SUB_BUCKETS - 1;
+    const uint64_t sub_bucket = bucket - magnitude * HALF_SUB_BUCKETS;
+    return ((sub_bucket + 1) << magnitude) - 1;
+}
+
+void Histogram::record(uint64_t value) {
+    counts[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t current = maximum.load(std::memory_order_relaxed);
+    while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::reset() {
+    for (std::atomic<uint64_t>& count : counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    total = 0;
+    sum = 0;
+    maximum = 0;
+}
+
+double Histogram::mean() const {
+    const uint64_t n = total;
+    return n > 0 ? static_cast<double>(sum) / n : 0.0;
+}
+
+uint64_t Histogram::percentile(double percent) const {
+    const uint64_t n = total;
+    if (n == 0) {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(percent / 100.0 * n + 0.5);
+    if (target < 1) target = 1;
+    if (target > n) target = n;
+
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+        seen += counts[bucket].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            const uint64_t value = highest_value_of(bucket);
+            return value < maximum ? value : maximum.load();
+        }
+    }
+    return maximum;
+}
+
+void Histogram::write(std::ostream& out) const {
+    out << "# " << name << " (" << unit << "): count " << count() << ", mean " << std::fixed << std::setprecision(1) << mean()
+        << ", max " << max() << "\n";
+    out << std::setw(14) << "value" << std::setw(12) << "percentile" << std::setw(14) << "count\n";
+    const double percents[] = {0.0, 10.0, 25.0, 50.0, 75.0, 90.0, 95.0, 99.0, 99.9, 99.99, 100.0};
+    for (double percent : percents) {
+        const uint64_t value = percentile(percent);
+        uint64_t at_or_below = 0;
+        for (size_t bucket = 0; bucket <= bucket_of(value) && bucket < BUCKETS; bucket++) {
+            at_or_below += counts[bucket].load(std::memory_order_relaxed);
+        }
+        out << std::setw(14) << value << std::setw(12) << std::setprecision(2) << percent << std::setw(13) << at_or_below << "\n";
+    }
+    out << "\n";
+}
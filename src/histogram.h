@@ -0,0 +1,47 @@
+// Latency Histograms
+//   Fixed-memory, HDR-style histograms: values below 128 get a bucket each, larger values share 64 buckets per power
+//   of two, so every recorded value is kept within 1/64 (~1.6%) of its true value over the whole uint64_t range,
+//   in a few KB that never grow. record() is lock-free (relaxed atomics), so any thread can record while the GUI reads.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+class Histogram {
+public:
+    // unit is only used for display, e.g. "us" or "bytes/s"
+    explicit Histogram(std::string name = "", std::string unit = "");
+
+    void record(uint64_t value);
+    void reset();
+
+    const std::string& get_name() const { return name; }
+    const std::string& get_unit() const { return unit; }
+    uint64_t count() const { return total; }
+    uint64_t max() const { return maximum; }
+    double mean() const;
+    // Value at or below which `percent` of the recorded values fall (0 when empty)
+    uint64_t percentile(double percent) const;
+
+    // Writes a percentile distribution (HDR style: value, percentile, total count)
+    void write(std::ostream& out) const;
+
+private:
+    static const int SUB_BUCKET_BITS = 7;
+    static const size_t HALF_SUB_BUCKETS = size_t(1) << (SUB_BUCKET_BITS - 1);
+    static const size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * HALF_SUB_BUCKETS + HALF_SUB_BUCKETS;
+
+    static size_t bucket_of(uint64_t value);
+    static uint64_t highest_value_of(size_t bucket);
+
+    std::string name;
+    std::string unit;
+    std::array<std::atomic<uint64_t>, BUCKETS> counts;
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> maximum{0};
+};
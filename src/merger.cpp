@@ -0,0 +1,90 @@
+#include "merger.h"
+
+#include <algorithm>
+#include <cmath>
+
+void StreamMerger::configure(size_t count, double new_period) {
+    sources.assign(count, Source{});
+    period = new_period > 0.0 ? new_period : 0.01;
+    next_t = std::numeric_limits<double>::quiet_NaN();
+    newest = 0.0;
+}
+
+void StreamMerger::add(size_t source, const Sample& sample) {
+    if (source >= sources.size()) {
+        return;
+    }
+    sources[source].samples.push_back(sample);
+    if (sample.t > newest) {
+        newest = sample.t;
+    }
+}
+
+size_t StreamMerger::merge(std::vector<MergedRow>& rows) {
+    if (sources.empty()) {
+        return 0;
+    }
+
+    // The timebase starts at the first multiple of period that every source with samples has reached
+    if (std::isnan(next_t)) {
+        double start = 0.0;
+        size_t started = 0;
+        for (const Source& source : sources) {
+            if (!source.samples.empty()) {
+                start = std::max(start, source.samples.front().t);
+                started++;
+            }
+        }
+        if (started == 0 || (started < sources.size() && newest - start < MERGE_LATENCY)) {
+            return 0;
+        }
+        next_t = std::ceil(start / period) * period;
+    }
+
+    size_t appended = 0;
+    while (true) {
+        // Every source must either reach next_t or be too far behind to wait for
+        bool complete = true;
+        for (const Source& source : sources) {
+            bool reached = !source.samples.empty() && source.samples.back().t >= next_t;
+            bool behind = (source.samples.empty() || source.samples.back().t < next_t) && newest - next_t > MERGE_LATENCY;
+            if (!reached && !behind) {
+                complete = false;
+                break;
+            }
+        }
+        if (!complete) {
+            break;
+        }
+
+        MergedRow row;
+        row.t = next_t;
+        row.values.reserve(sources.size() * 2);
+        for (Source& source : sources) {
+            std::deque<Sample>& samples = source.samples;
+            // Drops samples that no later row needs: keeps the last one at or before next_t
+            while (samples.size() >= 2 && samples[1].t <= next_t) {
+                samples.pop_front();
+            }
+            if (samples.empty() || samples.back().t < next_t) {
+                row.values.push_back(std::numeric_limits<float>::quiet_NaN());
+                row.values.push_back(std::numeric_limits<float>::quiet_NaN());
+                continue;
+            }
+            const Sample& a = samples.front();
+            if (samples.size() == 1 || a.t >= next_t) {
+                row.values.push_back(a.v);
+                row.values.push_back(a.h);
+                continue;
+            }
+            const Sample& b = samples[1];
+            const double w = (next_t - a.t) / (b.t - a.t);
+            row.values.push_back(static_cast<float>(a.v + (b.v - a.v) * w));
+            row.values.push_back(static_cast<float>(a.h + (b.h - a.h) * w));
+        }
+        rows.push_back(std::move(row));
+        appended++;
+        next_t += period;
+    }
+    return appended;
+}
@@ -0,0 +1,50 @@
+// Stream Merger
+//   Aligns the samples of several devices onto one common timebase: a row every `period` seconds, with each device's
+//   channels linearly interpolated at the row's time. All devices already timestamp on the host clock (see
+//   device_clock.h), so alignment only needs interpolation, not clock matching.
+//
+// A row is emitted once every source has a sample at or after its time. A source that falls more than MERGE_LATENCY
+//   behind the newest sample of any other source (e.g. unplugged or stalled) is reported as NaN instead of holding
+//   back the merged stream.
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <vector>
+
+#include "sample.h"
+
+const double MERGE_LATENCY = 0.5; // seconds
+
+// Values are ordered [source 0 v, source 0 h, source 1 v, source 1 h, ...]
+struct MergedRow {
+    double t;
+    std::vector<float> values;
+};
+
+class StreamMerger {
+public:
+    // Forgets all samples and starts a new timebase for `sources` devices
+    void configure(size_t sources, double period);
+
+    // Samples of each source must be added in time order
+    void add(size_t source, const Sample& sample);
+
+    // Appends every row that can be completed to rows. Returns the number of rows appended.
+    size_t merge(std::vector<MergedRow>& rows);
+
+    size_t get_sources() const { return sources.size(); }
+    double get_period() const { return period; }
+
+private:
+    struct Source {
+        std::deque<Sample> samples;
+    };
+
+    std::vector<Source> sources;
+    double period = 0.01;
+    double next_t = std::numeric_limits<double>::quiet_NaN(); // time of the next row (NaN until the first samples)
+    double newest = 0.0; // newest sample time over all sources
+};
@@ -0,0 +1,96 @@
+#include "plot_store.h"
+
+#include <algorithm>
+
+void MinMaxPyramid::add(double t, float y) {
+    const uint32_t index = static_cast<uint32_t>(times.size());
+    times.push_back(t);
+    values.push_back(y);
+
+    // Updates the (possibly still partial) block containing this sample on every level. Level k is only created
+    //   once it has a second block, as a single block summarizes nothing the level below doesn't
+    for (size_t k = 1;; k++) {
+        const size_t block = index >> (PYRAMID_BRANCH_SHIFT * k);
+        if (block == 0) {
+            break;
+        }
+        if (levels.size() < k) {
+            Block first{values[0], values[0], 0, 0};
+            for (uint32_t i = 1; i < index; i++) {
+                if (values[i] < first.min) { first.min = values[i]; first.min_index = i; }
+                if (values[i] > first.max) { first.max = values[i]; first.max_index = i; }
+            }
+            levels.push_back({first});
+        }
+        std::vector<Block>& level = levels[k - 1];
+        if (block == level.size()) {
+            level.push_back({y, y, index, index});
+        } else {
+            Block& b = level[block];
+            if (y < b.min) { b.min = y; b.min_index = index; }
+            if (y > b.max) { b.max = y; b.max_index = index; }
+        }
+    }
+}
+
+void MinMaxPyramid::clear() {
+    times.clear();
+    values.clear();
+    levels.clear();
+}
+
+void MinMaxPyramid::emit(size_t index, std::vector<double>& xs, std::vector<double>& ys) const {
+    xs.push_back(times[index]);
+    ys.push_back(values[index]);
+}
+
+void MinMaxPyramid::query(double t0, double t1, int max_points, std::vector<double>& xs, std::vector<double>& ys) const {
+    xs.clear();
+    ys.clear();
+    if (times.empty() || t1 < t0) {
+        return;
+    }
+
+    // Sample range [first, last] covering [t0, t1], widened by one sample on each side
+    size_t first = std::lower_bound(times.begin(), times.end(), t0) - times.begin();
+    size_t last = std::upper_bound(times.begin(), times.end(), t1) - times.begin();
+    if (first > 0) first--;
+    if (last >= times.size()) last = times.size() - 1;
+    if (last < first) {
+        return;
+    }
+    const size_t count = last - first + 1;
+    const size_t budget = static_cast<size_t>(std::max(max_points, 1));
+
+    // Finest level with at most budget blocks in range (level 0 = raw samples)
+    size_t k = 0;
+    while (k < levels.size() && (count >> (PYRAMID_BRANCH_SHIFT * k)) > budget) {
+        k++;
+    }
+
+    if (k == 0) {
+        xs.reserve(count);
+        ys.reserve(count);
+        for (size_t i = first; i <= last; i++) {
+            emit(i, xs, ys);
+        }
+        return;
+    }
+
+    const std::vector<Block>& level = levels[k - 1];
+    const size_t shift = PYRAMID_BRANCH_SHIFT * k;
+    const size_t first_block = first >> shift;
+    const size_t last_block = std::min(last >> shift, level.size() - 1);
+    xs.reserve((last_block - first_block + 1) * 2 + 2);
+    ys.reserve((last_block - first_block + 1) * 2 + 2);
+
+    emit(first, xs, ys);
+    for (size_t j = first_block; j <= last_block; j++) {
+        const Block& b = level[j];
+        const size_t a = std::min(b.min_index, b.max_index);
+        const size_t c = std::max(b.min_index, b.max_index);
+        if (a > first && a < last) emit(a, xs, ys);
+        if (c != a && c > first && c < last) emit(c, xs, ys);
+    }
+    emit(last, xs, ys);
+}
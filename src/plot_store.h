@@ -0,0 +1,44 @@
+// Decimated Plot Data
+//   Keeps every sample of a channel for the whole session, plus a min/max pyramid over it: level k summarizes
+//   blocks of PYRAMID_BRANCH^k samples by their minimum and maximum. A query for any time range picks the coarsest
+//   level with at most one block per pixel (two points), so drawing cost follows the plot width, not the sample count.
+//   Each block contributes its actual min and max sample (in time order), so peaks are never hidden by decimation.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const size_t PYRAMID_BRANCH_SHIFT = 2; // 4 samples (or blocks) per block of the next level
+
+class MinMaxPyramid {
+public:
+    // Samples must be added in time order
+    void add(double t, float y);
+    void clear();
+
+    size_t size() const { return times.size(); }
+    bool empty() const { return times.empty(); }
+    double front_time() const { return times.front(); }
+    double back_time() const { return times.back(); }
+    float back_value() const { return values.back(); }
+
+    // Writes the points to draw for [t0, t1] into xs/ys (replacing their contents): at most ~2 * max_points points,
+    //   plus the neighbouring sample on each side so the line reaches the plot edges
+    void query(double t0, double t1, int max_points, std::vector<double>& xs, std::vector<double>& ys) const;
+
+private:
+    struct Block {
+        float min;
+        float max;
+        uint32_t min_index;
+        uint32_t max_index;
+    };
+
+    void emit(size_t index, std::vector<double>& xs, std::vector<double>& ys) const;
+
+    std::vector<double> times;
+    std::vector<float> values;
+    std::vector<std::vector<Block>> levels; // levels[k - 1] holds the level k blocks
+};
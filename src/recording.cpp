@@ -0,0 +1,293 @@
+#include "recording.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Records per write block (~768 KiB)
+const size_t BLOCK_RECORDS = 1 << 15;
+// A partially filled block is still handed to the writer after this long, so a crash loses at most ~1 s of data
+const double BLOCK_MAX_AGE = 1.0;
+
+Recorder::~Recorder() {
+    close();
+}
+
+bool Recorder::open(const std::string& file_path, const RecordingInfo& info, double start) {
+    close();
+
+    file = std::fopen(file_path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Error: the recording " << file_path << " could not be opened or written to." << std::endl;
+        return false;
+    }
+    path = file_path;
+    t0 = start;
+    record_count = 0;
+    index.clear();
+    {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        error.clear();
+    }
+
+    header = RecordingHeader{};
+    std::memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    header.version = RECORDING_VERSION;
+    header.header_size = sizeof(RecordingHeader);
+    header.record_size = sizeof(SampleRecord);
+    header.index_interval = RECORDING_INDEX_INTERVAL;
+    header.start_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    header.calibration_v = static_cast<float>(info.calibration.factor_v);
+    header.calibration_h = static_cast<float>(info.calibration.factor_h);
+    header.calibration = info.calibration;
+    header.base_angle = info.base_angle;
+    std::strncpy(header.port, info.port.c_str(), sizeof(header.port) - 1);
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+        std::cerr << "Error: the recording " << file_path << " could not be written to: " << std::strerror(errno) << std::endl;
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    block.clear();
+    block.reserve(BLOCK_RECORDS);
+    stopping = false;
+    writer = std::thread(&Recorder::run, this);
+    return true;
+}
+
+void Recorder::append(double t, float raw_v, float raw_h, int16_t angle) {
+    if (!file) {
+        return;
+    }
+    SampleRecord record{};
+    record.t = t - t0;
+    record.raw_v = raw_v;
+    record.raw_h = raw_h;
+    record.angle = angle;
+
+    if (record_count % RECORDING_INDEX_INTERVAL == 0) {
+        index.push_back({record.t, record_count});
+    }
+    record_count++;
+
+    block.push_back(record);
+    if (block.size() >= BLOCK_RECORDS || record.t - block.front().t >= BLOCK_MAX_AGE) {
+        flush_block();
+    }
+}
+
+// Hands the current block to the writer thread and continues with a recycled one
+void Recorder::flush_block() {
+    if (block.empty()) {
+        return;
+    }
+    std::vector<SampleRecord> next;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue.push_back(std::move(block));
+        queued_at.push_back(std::chrono::steady_clock::now());
+        if (!spare_blocks.empty()) {
+            next = std::move(spare_blocks.back());
+            spare_blocks.pop_back();
+        }
+    }
+    queue_cv.notify_one();
+    next.clear();
+    next.reserve(BLOCK_RECORDS);
+    block = std::move(next);
+}
+
+void Recorder::run() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    for (;;) {
+        queue_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            return; // stopping, and everything has been written
+        }
+        std::vector<SampleRecord> pending = std::move(queue.front());
+        const auto handed_over = queued_at.front();
+        queue.pop_front();
+        queued_at.pop_front();
+
+        lock.unlock();
+        // After a failed write the rest is dropped, so the file keeps only whole records in time order
+        if (get_error().empty() && std::fwrite(pending.data(), sizeof(SampleRecord), pending.size(), file) != pending.size()) {
+            fail("writing samples failed");
+        }
+        write_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - handed_over).count());
+        lock.lock();
+
+        if (spare_blocks.size() < 2) {
+            spare_blocks.push_back(std::move(pending));
+        }
+    }
+}
+
+// Records the first write error, which the GUI and headless report
+void Recorder::fail(const std::string& what) {
+    const std::string reason = what + ": " + std::strerror(errno);
+    std::lock_guard<std::mutex> lock(error_mutex);
+    if (error.empty()) {
+        error = reason;
+        std::cerr << "Error: the recording " << path << " is incomplete, " << reason << "." << std::endl;
+    }
+}
+
+std::string Recorder::get_error() const {
+    std::lock_guard<std::mutex> lock(error_mutex);
+    return error;
+}
+
+bool Recorder::close() {
+    if (!file) {
+        return get_error().empty();
+    }
+    flush_block();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_one();
+    writer.join();
+
+    // Appends the index, then patches the header now that the totals are known. Once samples are missing neither is
+    //   written, and the reader treats the file like one from a crashed run.
+    if (get_error().empty()) {
+        header.record_count = record_count;
+        header.index_offset = sizeof(RecordingHeader) + record_count * sizeof(SampleRecord);
+        header.index_count = index.size();
+        if (std::fwrite(index.data(), sizeof(IndexEntry), index.size(), file) != index.size()) {
+            fail("writing the index failed");
+        } else if (std::fseek(file, 0, SEEK_SET) != 0 || std::fwrite(&header, sizeof(header), 1, file) != 1) {
+            fail("writing the header failed");
+        }
+    }
+    if (std::fclose(file) != 0) {
+        fail("closing the file failed");
+    }
+    file = nullptr;
+    spare_blocks.clear();
+
+    if (!get_error().empty()) {
+        return false;
+    }
+    std::cout << "Recorded " << record_count << " samples to " << path << std::endl;
+    return true;
+}
+
+RecordingReader::~RecordingReader() {
+    close();
+}
+
+bool RecordingReader::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: the recording " << path << " could not be opened or read from." << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(RecordingHeader)) {
+        std::cerr << "Error: " << path << " is not a recording." << std::endl;
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: the recording " << path << " could not be memory-mapped." << std::endl;
+        return false;
+    }
+    data = static_cast<const uint8_t*>(mapping);
+
+    const RecordingHeader& header = get_header();
+    if (std::memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0 || header.version < 1 || header.version > RECORDING_VERSION ||
+        header.record_size != sizeof(SampleRecord) || header.header_size != sizeof(RecordingHeader)) {
+        std::cerr << "Error: " << path << " is not a version 1 to " << RECORDING_VERSION << " recording." << std::endl;
+        close();
+        return false;
+    }
+
+    records = reinterpret_cast<const SampleRecord*>(data + header.header_size);
+    const uint64_t available = (length - header.header_size) / sizeof(SampleRecord);
+    if (header.index_offset != 0 && header.record_count <= available &&
+        header.index_offset + header.index_count * sizeof(IndexEntry) <= length) {
+        count = header.record_count;
+        index = reinterpret_cast<const IndexEntry*>(data + header.index_offset);
+        index_count = header.index_count;
+    } else {
+        // Not closed cleanly: every complete record is usable, but there is no index
+        count = available;
+        index = nullptr;
+        index_count = 0;
+    }
+
+    // Access is mostly sequential (replay), so ask the kernel to read ahead
+    madvise(const_cast<uint8_t*>(data), length, MADV_SEQUENTIAL);
+    return true;
+}
+
+void RecordingReader::close() {
+    if (data) {
+        munmap(const_cast<uint8_t*>(data), length);
+    }
+    data = nullptr;
+    length = 0;
+    records = nullptr;
+    count = 0;
+    index = nullptr;
+    index_count = 0;
+}
+
+Calibration RecordingReader::get_calibration() const {
+    const RecordingHeader& header = get_header();
+    if (header.version >= 2) {
+        return header.calibration;
+    }
+    Calibration calibration;
+    calibration.factor_v = header.calibration_v;
+    calibration.factor_h = header.calibration_h;
+    return calibration;
+}
+
+void RecordingReader::get_raw(const SampleRecord& record, float& raw_v, float& raw_h) const {
+    const RecordingHeader& header = get_header();
+    if (header.version >= 2) {
+        raw_v = record.raw_v;
+        raw_h = record.raw_h;
+    } else {
+        raw_v = record.raw_v * header.calibration_v;
+        raw_h = record.raw_h * header.calibration_h;
+    }
+}
+
+uint64_t RecordingReader::find(double t) const {
+    uint64_t low = 0;
+    uint64_t high = count;
+
+    // The index narrows the search to one interval, so only a few pages of records are touched
+    if (index_count > 0) {
+        const IndexEntry* entry = std::upper_bound(index, index + index_count, t,
+                                                   [](double value, const IndexEntry& e) { return value < e.t; });
+        if (entry != index) {
+            low = (entry - 1)->record;
+        }
+        if (entry != index + index_count) {
+            high = std::min<uint64_t>(entry->record, count);
+        }
+    }
+
+    const SampleRecord* found = std::lower_bound(records + low, records + high, t,
+                                                 [](const SampleRecord& r, double value) { return r.t < value; });
+    return static_cast<uint64_t>(found - records);
+}
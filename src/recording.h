@@ -0,0 +1,164 @@
+// Run Recordings
+//   Append-only binary files (.wtr) holding every sample of a run, plus the recorder that writes them
+//   and the memory-mapped reader used for replay.
+//
+// File layout (little-endian, as written by the host):
+//   [RecordingHeader: 512 bytes]
+//   [SampleRecord x record_count: 24 bytes each, in time order]
+//   [IndexEntry x index_count: one every index_interval records] (only present if the recorder was closed cleanly)
+// The header's record_count/index_offset/index_count are patched when the recorder closes. A file from a crashed
+// run has them set to 0; the reader then derives the record count from the file size and searches without the index.
+// Since version 2 the records hold raw load cell counts and the header the calibration used live, so a run can be
+// replayed or analyzed with another calibration. Version 1 files (calibrated by the sketch) are still read.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "calibration.h"
+#include "histogram.h"
+
+const char RECORDING_MAGIC[8] = {'W', 'T', 'R', 'E', 'C', 'O', 'R', 'D'};
+const uint32_t RECORDING_VERSION = 2;
+const uint32_t RECORDING_INDEX_INTERVAL = 1024;
+
+struct RecordingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t index_interval;
+    int64_t start_time_ns;     // wall clock (unix epoch) when the recording started
+    float calibration_v;       // calibration factors (counts per unit)
+    float calibration_h;
+    int16_t base_angle;
+    uint16_t reserved0;
+    uint32_t reserved1;
+    uint64_t record_count;
+    uint64_t index_offset;     // file offset of the index, 0 if there is none
+    uint64_t index_count;
+    char port[128];
+    Calibration calibration;   // full calibration used live (version 2 and later)
+    uint8_t reserved[264];
+};
+
+struct SampleRecord {
+    double t;                  // seconds since the recording started
+    float raw_v;               // raw counts (version 1: the forces calibrated by the sketch)
+    float raw_h;
+    int16_t angle;             // absolute servo angle commanded when the sample arrived
+    uint16_t flags;
+    uint32_t reserved;
+};
+
+struct IndexEntry {
+    double t;
+    uint64_t record;
+};
+
+static_assert(sizeof(RecordingHeader) == 512, "RecordingHeader must stay 512 bytes");
+static_assert(sizeof(SampleRecord) == 24, "SampleRecord must stay 24 bytes");
+static_assert(sizeof(IndexEntry) == 16, "IndexEntry must stay 16 bytes");
+
+// What the recorder stores in the header
+struct RecordingInfo {
+    std::string port;
+    Calibration calibration;
+    int16_t base_angle;
+};
+
+// Writes a recording from one producer thread. append() only copies into an in-memory block;
+//   full blocks are handed to a background thread that writes them with large fwrite() calls.
+class Recorder {
+public:
+    Recorder() = default;
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // t0 is the host time that becomes t = 0 in the file
+    bool open(const std::string& path, const RecordingInfo& info, double t0);
+    void append(double t, float raw_v, float raw_h, int16_t angle);
+    // False if any write failed; the file is then left as after a crash (no index, totals 0)
+    bool close();
+
+    bool is_open() const { return file != nullptr; }
+    const std::string& get_path() const { return path; }
+    uint64_t get_record_count() const { return record_count; }
+    // Why writing the recording failed, empty while it is fine. Kept after close() until the next open()
+    std::string get_error() const;
+    // Time from handing a block to the writer thread until it was written
+    const Histogram& get_write_latency() const { return write_latency; }
+
+private:
+    void run();
+    void flush_block();
+    void fail(const std::string& what);
+
+    std::FILE* file = nullptr;
+    std::string path;
+    RecordingHeader header{};
+    double t0 = 0.0;
+    uint64_t record_count = 0;
+    std::vector<IndexEntry> index;
+
+    // Producer side block, and blocks waiting for the writer thread
+    std::vector<SampleRecord> block;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<std::vector<SampleRecord>> queue;
+    std::deque<std::chrono::steady_clock::time_point> queued_at; // when each queued block was handed over
+    std::vector<std::vector<SampleRecord>> spare_blocks;
+    bool stopping = false;
+    std::thread writer;
+    Histogram write_latency{"recorder block write", "us"};
+
+    mutable std::mutex error_mutex;
+    std::string error;
+};
+
+// Read-only, memory-mapped view of a recording. Opening is O(1) regardless of the file size:
+//   pages are only read from disk when records are accessed.
+class RecordingReader {
+public:
+    RecordingReader() = default;
+    ~RecordingReader();
+
+    RecordingReader(const RecordingReader&) = delete;
+    RecordingReader& operator=(const RecordingReader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool is_open() const { return data != nullptr; }
+    const RecordingHeader& get_header() const { return *reinterpret_cast<const RecordingHeader*>(data); }
+    const SampleRecord* get_records() const { return records; }
+    uint64_t size() const { return count; }
+    double duration() const { return count > 0 ? records[count - 1].t : 0.0; }
+
+    // The calibration the run was recorded with
+    Calibration get_calibration() const;
+    // Raw counts of a record. Version 1 records only hold forces, which are turned back into counts of the recorded
+    //   calibration (zero offsets, no cross-talk), so only the calibration factors of these runs can be changed.
+    void get_raw(const SampleRecord& record, float& raw_v, float& raw_h) const;
+
+    // Index of the first record with time >= t (size() if there is none), in O(log n)
+    uint64_t find(double t) const;
+
+private:
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    const SampleRecord* records = nullptr;
+    uint64_t count = 0;
+    const IndexEntry* index = nullptr;
+    uint64_t index_count = 0;
+};
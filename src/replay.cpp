@@ -0,0 +1,123 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+const auto REPLAY_INTERVAL = std::chrono::milliseconds(5);
+
+ReplayPlayer::~ReplayPlayer() {
+    stop();
+}
+
+bool ReplayPlayer::open(const std::string& path) {
+    stop();
+    if (!reader.open(path)) {
+        return false;
+    }
+    base_position = 0.0;
+    base_time = host_time();
+    cursor = 0;
+    return true;
+}
+
+void ReplayPlayer::start(SpscRing<Sample>& ring, SignalStage* stage) {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(clock_mutex);
+        base_time = host_time();
+    }
+    running = true;
+    thread = std::thread(&ReplayPlayer::run, this, &ring, stage);
+}
+
+void ReplayPlayer::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+double ReplayPlayer::get_position() const {
+    std::lock_guard<std::mutex> lock(clock_mutex);
+    return position_locked();
+}
+
+double ReplayPlayer::position_locked() const {
+    if (paused) {
+        return base_position;
+    }
+    return std::min(base_position + (host_time() - base_time) * speed, reader.duration());
+}
+
+void ReplayPlayer::set_speed(float value) {
+    std::lock_guard<std::mutex> lock(clock_mutex);
+    double now = host_time();
+    if (!paused) {
+        base_position += (now - base_time) * speed;
+    }
+    base_time = now;
+    speed = value;
+}
+
+void ReplayPlayer::set_paused(bool value) {
+    std::lock_guard<std::mutex> lock(clock_mutex);
+    double now = host_time();
+    if (!paused && value) {
+        base_position += (now - base_time) * speed;
+    }
+    base_time = now;
+    paused = value;
+}
+
+void ReplayPlayer::seek(double t) {
+    std::lock_guard<std::mutex> lock(clock_mutex);
+    base_position = t;
+    base_time = host_time();
+    cursor = reader.find(t);
+    seeks++;
+}
+
+void ReplayPlayer::run(SpscRing<Sample>* ring, SignalStage* stage) {
+    const SampleRecord* records = reader.get_records();
+    const Calibration calibration = reader.get_calibration(); // replaced by the stage's calibration, if there is one
+    std::vector<Sample> block;
+
+    while (running) {
+        block.clear();
+        uint64_t collected_at;
+        {
+            std::lock_guard<std::mutex> lock(clock_mutex);
+            // Collects every record up to the playback position, without overrunning the consumer. The position is
+            //   read under the same lock as the cursor, so a seek can't move one without the other.
+            const double position = position_locked();
+            size_t space = ring->capacity() - ring->size();
+            while (cursor < reader.size() && records[cursor].t <= position && block.size() < space) {
+                const SampleRecord& record = records[cursor++];
+                Sample sample;
+                sample.t = record.t;
+                reader.get_raw(record, sample.raw_v, sample.raw_h);
+                calibration.apply(sample);
+                sample.v_filtered = sample.v;
+                sample.h_filtered = sample.h;
+                sample.angle = record.angle;
+                block.push_back(sample);
+            }
+            collected_at = seeks;
+        }
+        if (stage) {
+            stage->process(block.data(), block.size());
+        }
+        {
+            // Pushed under the clock lock, so a seek either comes before the check (and the block is dropped) or
+            //   waits until the block is in the ring, where the consumer discards it
+            std::lock_guard<std::mutex> lock(clock_mutex);
+            if (collected_at == seeks) {
+                for (const Sample& sample : block) {
+                    ring->push(sample);
+                }
+            }
+        }
+        std::this_thread::sleep_for(REPLAY_INTERVAL);
+    }
+}
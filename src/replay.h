@@ -0,0 +1,63 @@
+// Recording Replay
+//   Feeds a memory-mapped recording into a sample ring at 1x or faster, so recorded runs go through
+//   exactly the same path (ring -> render loop -> plots) as live data.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "recording.h"
+#include "sample.h"
+#include "signal_stage.h"
+#include "spsc_ring.h"
+
+class ReplayPlayer {
+public:
+    ReplayPlayer() = default;
+    ~ReplayPlayer();
+
+    ReplayPlayer(const ReplayPlayer&) = delete;
+    ReplayPlayer& operator=(const ReplayPlayer&) = delete;
+
+    bool open(const std::string& path);
+    // Starts the replay thread, which pushes samples into ring (timestamps are seconds since the recording started).
+    //   If given, stage processes each block on the replay thread first, like live data on the I/O thread, and its
+    //   calibration is applied instead of the recorded one (see get_calibration()).
+    void start(SpscRing<Sample>& ring, SignalStage* stage = nullptr);
+    void stop();
+
+    void set_speed(float speed);
+    void set_paused(bool paused);
+    // Once seek() returns, no sample from before it is pushed any more; the consumer discards whatever is already
+    //   in the ring, so the samples it gets stay in time order
+    void seek(double t);
+
+    bool is_open() const { return reader.is_open(); }
+    bool is_paused() const { return paused; }
+    float get_speed() const { return speed; }
+    double get_position() const;
+    double get_duration() const { return reader.duration(); }
+    const RecordingHeader& get_header() const { return reader.get_header(); }
+    Calibration get_calibration() const { return reader.get_calibration(); }
+
+private:
+    void run(SpscRing<Sample>* ring, SignalStage* stage);
+    // get_position() for a caller that already holds clock_mutex
+    double position_locked() const;
+
+    RecordingReader reader;
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    // Playback clock: position = base_position + (now - base_time) * speed while playing
+    mutable std::mutex clock_mutex;
+    double base_position = 0.0;
+    double base_time = 0.0;
+    uint64_t cursor = 0;
+    uint64_t seeks = 0;      // counts seek() calls, so a block collected before one is dropped
+    std::atomic<float> speed{1.0f};
+    std::atomic<bool> paused{false};
+};
@@ -0,0 +1,45 @@
+// Sample Model
+//   A single reading from both load cells, timestamped by the Arduino when it was measured. The Arduino sends raw
+//   HX711 counts; v/h are filled in by the host's calibration (see calibration.h).
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "wt_protocol.h"
+#include "device_clock.h"
+
+struct Sample {
+    double t;  // seconds since the program started (see host_time), mapped from the device timestamp
+    float raw_v; // raw vertical HX711 counts (averaged by the sketch's HX711 library, so not always whole)
+    float raw_h; // raw horizontal HX711 counts
+    float v;   // vertical load cell reading
+    float h;   // horizontal load cell reading
+    float v_filtered; // v and h after the acquisition filters (see signal_stage.h), equal to v/h when unfiltered
+    float h_filtered;
+    int16_t angle; // absolute servo angle the Arduino had when the sample was measured
+};
+
+// Seconds since the program started (steady clock), shared by every thread that timestamps samples
+inline double host_time() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Decodes a WT_MSG_SAMPLE frame received at host time received, mapping its timestamp through clock.
+//   v/h are left equal to the raw counts until a calibration is applied. Returns false for any other frame.
+inline bool sample_from_frame(const WtFrame& frame, DeviceClock& clock, double received, Sample& sample) {
+    if (frame.type != WT_MSG_SAMPLE || frame.length != WT_SAMPLE_SIZE) {
+        return false;
+    }
+    sample.t = clock.map(wt_get_u32(frame.payload), received);
+    sample.angle = wt_get_i16(frame.payload + 4);
+    sample.raw_v = wt_get_f32(frame.payload + 6);
+    sample.raw_h = wt_get_f32(frame.payload + 10);
+    sample.v = sample.raw_v;
+    sample.h = sample.raw_h;
+    sample.v_filtered = sample.v;
+    sample.h_filtered = sample.h;
+    return true;
+}
@@ -0,0 +1,241 @@
+#include "sample_feed.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// POSIX shared memory names start with a single slash
+std::string shm_name (const std::string& name) {
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+bool process_alive (int64_t pid) {
+    return pid > 0 && (kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM);
+}
+
+size_t segment_size (size_t capacity) {
+    return sizeof(FeedHeader) + capacity * sizeof(FeedSlot);
+}
+
+// Checks that a mapped segment of size bytes holds a complete feed
+bool valid_header (const FeedHeader* header, size_t size) {
+    return std::memcmp(header->magic, FEED_MAGIC, sizeof(FEED_MAGIC)) == 0 && header->version == FEED_VERSION
+        && header->header_size == sizeof(FeedHeader) && header->slot_size == sizeof(FeedSlot)
+        && header->capacity > 0 && (header->capacity & (header->capacity - 1)) == 0
+        && size >= segment_size(header->capacity);
+}
+
+// True if the segment under name belongs to a live publisher (it is left alone) or could not be inspected
+bool segment_in_use (const std::string& name, int64_t& pid) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    bool in_use = false;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(FeedHeader)) {
+        void* mapping = mmap(nullptr, sizeof(FeedHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            const FeedHeader* header = static_cast<const FeedHeader*>(mapping);
+            pid = header->publisher_pid;
+            in_use = header->closed.load(std::memory_order_acquire) == 0 && process_alive(pid);
+            munmap(mapping, sizeof(FeedHeader));
+        }
+    }
+    ::close(fd);
+    return in_use;
+}
+
+}
+
+FeedPublisher::~FeedPublisher() {
+    close();
+}
+
+bool FeedPublisher::open(const std::string& feed_name, int16_t base_angle, size_t capacity) {
+    close();
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    capacity = size;
+
+    const std::string path = shm_name(feed_name);
+    int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        int64_t pid = 0;
+        if (segment_in_use(path, pid)) {
+            std::cerr << "Error: the feed " << path << " is already published by process " << pid << "." << std::endl;
+            return false;
+        }
+        shm_unlink(path.c_str()); // left behind by a publisher that crashed
+        fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+        std::cerr << "Error: the feed " << path << " could not be created (" << std::strerror(errno) << ")." << std::endl;
+        return false;
+    }
+
+    const size_t length = segment_size(capacity);
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(length)) == 0) {
+        mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: the feed " << path << " could not be mapped (" << std::strerror(errno) << ")." << std::endl;
+        shm_unlink(path.c_str());
+        return false;
+    }
+
+    // The segment starts zeroed, so every slot's sequence is 0 (nothing published)
+    FeedHeader* h = static_cast<FeedHeader*>(mapping);
+    h->version = FEED_VERSION;
+    h->header_size = sizeof(FeedHeader);
+    h->slot_size = sizeof(FeedSlot);
+    h->capacity = static_cast<uint32_t>(capacity);
+    const auto wall = std::chrono::system_clock::now().time_since_epoch();
+    h->start_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count()
+                     - static_cast<int64_t>(host_time() * 1e9);
+    h->publisher_pid = static_cast<int64_t>(getpid());
+    h->base_angle = base_angle;
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(h->magic, FEED_MAGIC, sizeof(FEED_MAGIC));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    name = path;
+    header = h;
+    slots = reinterpret_cast<FeedSlot*>(static_cast<uint8_t*>(mapping) + sizeof(FeedHeader));
+    mapped_size = length;
+    mask = capacity - 1;
+    std::cout << "Publishing samples to shared memory " << name << " (" << capacity << " records)" << std::endl;
+    return true;
+}
+
+void FeedPublisher::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!header) {
+        return;
+    }
+    header->closed.store(1, std::memory_order_release);
+    munmap(header, mapped_size);
+    shm_unlink(name.c_str());
+    header = nullptr;
+    slots = nullptr;
+}
+
+void FeedPublisher::publish(const Sample* block, size_t count, uint16_t source) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!header) {
+        return;
+    }
+    uint64_t index = header->write_index.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; i++, index++) {
+        FeedSlot& slot = slots[index & mask];
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // the odd sequence is visible before any of the record
+        const Sample& sample = block[i];
+        slot.record = {sample.t, sample.raw_v, sample.raw_h, sample.v, sample.h, sample.v_filtered, sample.h_filtered,
+                       sample.angle, source, 0};
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+    }
+    header->write_index.store(index, std::memory_order_release);
+}
+
+FeedReader::~FeedReader() {
+    close();
+}
+
+bool FeedReader::open(const std::string& feed_name) {
+    close();
+    const std::string path = shm_name(feed_name);
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    size_t length = 0;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(FeedHeader)) {
+        length = static_cast<size_t>(info.st_size);
+        mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    const FeedHeader* h = static_cast<const FeedHeader*>(mapping);
+    if (!valid_header(h, length)) {
+        munmap(mapping, length); // not a feed, or its publisher is still initializing it
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    header = h;
+    slots = reinterpret_cast<const FeedSlot*>(static_cast<const uint8_t*>(mapping) + sizeof(FeedHeader));
+    mapped_size = length;
+    mask = h->capacity - 1;
+    cursor = h->write_index.load(std::memory_order_acquire);
+    lost = 0;
+    return true;
+}
+
+void FeedReader::close() {
+    if (header) {
+        munmap(const_cast<FeedHeader*>(header), mapped_size);
+        header = nullptr;
+        slots = nullptr;
+    }
+}
+
+size_t FeedReader::read(FeedRecord* out, size_t max_count) {
+    if (!header) {
+        return 0;
+    }
+    size_t count = 0;
+    while (count < max_count) {
+        const FeedSlot& slot = slots[cursor & mask];
+        const uint64_t complete = 2 * cursor + 2;
+        const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before < complete) {
+            break; // not published yet (or being written right now)
+        }
+        if (before == complete) {
+            std::memcpy(&out[count], &slot.record, sizeof(FeedRecord));
+            std::atomic_thread_fence(std::memory_order_acquire); // the copy is done before the sequence is checked again
+            if (slot.sequence.load(std::memory_order_relaxed) == complete) {
+                count++;
+                cursor++;
+                continue;
+            }
+        }
+        // The publisher lapped this reader: skips ahead to the oldest record that is not being overwritten
+        const uint64_t written = header->write_index.load(std::memory_order_acquire);
+        const uint64_t oldest = written + 1 > mask + 1 ? written - mask : 0;
+        const uint64_t next = oldest > cursor ? oldest : cursor + 1;
+        lost += next - cursor;
+        cursor = next;
+    }
+    return count;
+}
+
+void FeedReader::rewind() {
+    if (!header) {
+        return;
+    }
+    const uint64_t written = header->write_index.load(std::memory_order_acquire);
+    cursor = written > mask ? written - mask : 0;
+}
+
+bool FeedReader::is_publisher_gone() const {
+    return header && (header->closed.load(std::memory_order_acquire) != 0 || !process_alive(header->publisher_pid));
+}
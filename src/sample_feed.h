@@ -0,0 +1,135 @@
+// Shared-Memory Sample Feed
+//   Publishes every acquired sample into a POSIX shared-memory ring, so other local processes (analysis scripts, a
+//   second display) can follow the live stream without touching the serial link or the GUI. The acquisition threads
+//   write into the ring directly after the signal stage; readers map it read-only and never slow the publisher down.
+//
+// Segment layout (shm_open name, "/windtunnel" by default; native byte order, as written by the host):
+//   [FeedHeader: 256 bytes]
+//   [FeedSlot x capacity: 48 bytes each, capacity a power of two]
+// Record i (counting from 0 since the publisher started) lives in slot i % capacity. Each slot is a seqlock: the
+// publisher sets its sequence to 2i+1 before writing record i and to 2i+2 once it is complete. A reader expecting
+// record i copies the slot and accepts it only if the sequence was 2i+2 both before and after the copy. A higher
+// sequence means the publisher has lapped the reader (the records in between are lost to it); a lower one means
+// record i has not been published yet. header.write_index counts the published records (updated once per block).
+// Any number of readers can follow the feed, each at its own pace, since none of them writes to the segment.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "sample.h"
+
+const char FEED_MAGIC[8] = {'W', 'T', 'F', 'E', 'E', 'D', 0, 0};
+const uint32_t FEED_VERSION = 1;
+const char DEFAULT_FEED_NAME[] = "/windtunnel";
+const size_t DEFAULT_FEED_CAPACITY = 1 << 16; // records (about 3 MB)
+
+struct FeedRecord {
+    double t;                  // seconds since the publisher started (see FeedHeader::start_time_ns)
+    float raw_v;               // raw load cell counts
+    float raw_h;
+    float v;                   // calibrated readings
+    float h;
+    float v_filtered;          // after the acquisition filters
+    float h_filtered;
+    int16_t angle;             // absolute servo angle
+    uint16_t source;           // 0 for the primary device, attached devices count up from 1
+    uint32_t reserved;
+};
+
+struct FeedSlot {
+    std::atomic<uint64_t> sequence;
+    FeedRecord record;
+};
+
+struct FeedHeader {
+    char magic[8];             // written last, once the segment is initialized
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t slot_size;
+    uint32_t capacity;
+    int64_t start_time_ns;     // wall clock (unix epoch) at t = 0
+    int64_t publisher_pid;
+    int16_t base_angle;
+    uint16_t reserved0;
+    uint32_t reserved1;
+    uint8_t reserved2[80];
+    alignas(64) std::atomic<uint64_t> write_index; // records published so far
+    std::atomic<uint32_t> closed;                  // set when the publisher shuts down
+    uint8_t reserved3[116];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the feed needs lock-free 64 bit atomics");
+static_assert(sizeof(FeedRecord) == 40, "FeedRecord must stay 40 bytes");
+static_assert(sizeof(FeedSlot) == 48, "FeedSlot must stay 48 bytes");
+static_assert(sizeof(FeedHeader) == 256, "FeedHeader must stay 256 bytes");
+
+// Creates the segment and writes to it. publish() may be called from several acquisition threads (one per device);
+//   they take turns on a mutex that is only ever contended by another publisher.
+class FeedPublisher {
+public:
+    FeedPublisher() = default;
+    ~FeedPublisher();
+
+    FeedPublisher(const FeedPublisher&) = delete;
+    FeedPublisher& operator=(const FeedPublisher&) = delete;
+
+    // Fails if another live process publishes under name. A segment left behind by a crashed publisher is replaced.
+    bool open(const std::string& name, int16_t base_angle, size_t capacity = DEFAULT_FEED_CAPACITY);
+    // Marks the feed closed for its readers and removes the name (readers keep their mapping until they close)
+    void close();
+    bool is_open() const { return header != nullptr; }
+
+    // Does nothing while closed
+    void publish(const Sample* block, size_t count, uint16_t source);
+
+    const std::string& get_name() const { return name; }
+    uint64_t get_published() const { return header ? header->write_index.load(std::memory_order_relaxed) : 0; }
+
+private:
+    std::mutex mutex;
+    std::string name;
+    FeedHeader* header = nullptr;
+    FeedSlot* slots = nullptr;
+    size_t mapped_size = 0;
+    uint64_t mask = 0;
+};
+
+// Follows a feed from another process. Not thread-safe: use one reader per consuming thread.
+class FeedReader {
+public:
+    FeedReader() = default;
+    ~FeedReader();
+
+    FeedReader(const FeedReader&) = delete;
+    FeedReader& operator=(const FeedReader&) = delete;
+
+    // Maps the feed read-only and starts at the newest record (see rewind()). Returns false, quietly, if there is no
+    //   feed under name yet, so callers can poll for a publisher.
+    bool open(const std::string& name = DEFAULT_FEED_NAME);
+    void close();
+    bool is_open() const { return header != nullptr; }
+
+    // Copies up to max_count records, in order, that were published since the last call. Records the publisher
+    //   overwrote before they were read are skipped and counted in get_lost().
+    size_t read(FeedRecord* out, size_t max_count);
+    // Moves back to the oldest record still in the ring
+    void rewind();
+
+    // True once the publisher closed the feed or its process is gone (a new publisher creates a new segment)
+    bool is_publisher_gone() const;
+    uint64_t get_lost() const { return lost; }
+    const FeedHeader& get_header() const { return *header; }
+
+private:
+    const FeedHeader* header = nullptr;
+    const FeedSlot* slots = nullptr;
+    size_t mapped_size = 0;
+    uint64_t mask = 0;
+    uint64_t cursor = 0;
+    uint64_t lost = 0;
+};
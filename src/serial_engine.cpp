@@ -0,0 +1,705 @@
+#include "serial_engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <stdexcept>
+
+#include "sample.h"
+
+// How long the I/O thread waits for incoming bytes before servicing queued writes again
+const uint32_t IO_POLL_MS = 2;
+const uint32_t WRITE_TIMEOUT_MS = 250;
+// A poll request that got no reply within this time is sent again
+const auto POLL_TIMEOUT = std::chrono::milliseconds(100);
+// Largest single read from the port
+const size_t READ_CHUNK_SIZE = 4096;
+// A keyed command is resent if the Arduino has not acknowledged it within this time, at most COMMAND_RETRIES times
+const auto ACK_TIMEOUT = std::chrono::milliseconds(250);
+const uint8_t COMMAND_RETRIES = 3;
+// Message type of each command queue slot
+const uint8_t COMMAND_TYPES[] = {WT_MSG_SET_ANGLE};
+// A probed port stays open and gets WT_MSG_HELLO every HELLO_INTERVAL for up to PROBE_TIMEOUT. An UNO resets when its
+//   port is opened: its bootloader takes up to about 2 s to start the sketch, whose setup() then spends at least 2 s
+//   stabilizing the load cells before it answers, so the first WT_MSG_IDENT comes 2.5 to 4 s after the port opens.
+//   Giving up sooner would reopen (and so reset) the board before it ever answers. Searches that find nothing are
+//   repeated every SEARCH_INTERVAL.
+const auto HELLO_INTERVAL = std::chrono::milliseconds(200);
+const auto PROBE_TIMEOUT = std::chrono::milliseconds(6000);
+const auto SEARCH_INTERVAL = std::chrono::milliseconds(1000);
+const auto SEARCH_STEP = std::chrono::milliseconds(50); // close() waits at most this long for a pause between searches
+// Link rates negotiate_baud() tries, fastest first (all accepted by WT_MSG_SET_BAUD). A rate is kept once
+//   NEGOTIATE_ROUNDS HELLO round trips at it come back clean, each within NEGOTIATE_TIMEOUT.
+const unsigned long LINK_BAUD_RATES[] = {2000000, 1000000, 500000};
+const int NEGOTIATE_ROUNDS = 20;
+const auto NEGOTIATE_TIMEOUT = std::chrono::milliseconds(300);
+// After a failed rate the device is back at the base rate within WT_LINK_TIMEOUT_MS (plus a margin)
+const auto RECOVER_TIMEOUT = std::chrono::milliseconds(WT_LINK_TIMEOUT_MS + 1000);
+// Above the base rate, the link is dropped (and renegotiated slower) when more than LINK_ERROR_RATIO of the frames of
+//   a LINK_CHECK_INTERVAL, and at least LINK_ERROR_MIN of them, arrive corrupted
+const auto LINK_CHECK_INTERVAL = std::chrono::milliseconds(1000);
+const double LINK_ERROR_RATIO = 0.01;
+const uint64_t LINK_ERROR_MIN = 3;
+const auto KEEPALIVE_INTERVAL = std::chrono::milliseconds(WT_KEEPALIVE_MS);
+
+// Slot of a setpoint in the command queue, or -1 for messages that are sent directly
+static int command_slot (uint8_t type) {
+    switch (type) {
+        case WT_MSG_SET_ANGLE: return 0;
+        default: return -1;
+    }
+}
+
+const char* link_state_name (LinkState state) {
+    switch (state) {
+        case LinkState::Closed: return "closed";
+        case LinkState::Searching: return "searching";
+        case LinkState::Connected: return "connected";
+        default: return "unknown";
+    }
+}
+
+// Ports owned (or being probed) by any engine in this process, so engines never open each other's port
+static std::mutex claimed_mutex;
+static std::set<std::string> claimed_ports;
+
+static bool claim_port (const std::string& port) {
+    std::lock_guard<std::mutex> lock(claimed_mutex);
+    return claimed_ports.insert(port).second;
+}
+
+static void release_port (const std::string& port) {
+    std::lock_guard<std::mutex> lock(claimed_mutex);
+    claimed_ports.erase(port);
+}
+
+// The read timeout bounds how long waitReadable() blocks, so writes queued meanwhile wait at most IO_POLL_MS
+static serial::Timeout io_timeout () {
+    return serial::Timeout(serial::Timeout::max(), IO_POLL_MS, 0, WRITE_TIMEOUT_MS, 0);
+}
+
+// Ports worth probing: preferred first, then every port with a USB device behind it (skips e.g. legacy /dev/ttyS*)
+static std::vector<std::string> candidate_ports (const std::string& preferred) {
+    std::vector<std::string> candidates;
+    if (!preferred.empty()) {
+        candidates.push_back(preferred);
+    }
+    for (const serial::PortInfo& info : serial::list_ports()) {
+        if (info.port != preferred && info.hardware_id != "n/a") {
+            candidates.push_back(info.port);
+        }
+    }
+    return candidates;
+}
+
+// Opens port and asks whatever is on it to identify itself until the wind tunnel sketch answers, PROBE_TIMEOUT passes
+//   or stop() returns true. Returns the open port if the sketch answered, nullptr otherwise.
+static std::unique_ptr<serial::Serial> probe_port (const std::string& name, unsigned long baud, const std::function<bool()>& stop) {
+    std::unique_ptr<serial::Serial> port;
+    try {
+        port = std::make_unique<serial::Serial>(name, baud, io_timeout());
+        if (!port->isOpen()) {
+            return nullptr;
+        }
+        WtReceiver receiver;
+        wt_receiver_reset(&receiver);
+        WtFrame frame;
+        uint8_t hello[WT_MAX_ENCODED_SIZE];
+        uint8_t seq = 0;
+        uint8_t chunk[256];
+        const auto start = std::chrono::steady_clock::now();
+        auto last_hello = start - HELLO_INTERVAL;
+        while (!stop() && std::chrono::steady_clock::now() - start < PROBE_TIMEOUT) {
+            if (std::chrono::steady_clock::now() - last_hello >= HELLO_INTERVAL) {
+                uint16_t size = wt_encode_frame(WT_MSG_HELLO, seq++, nullptr, 0, hello);
+                port->write(hello, size);
+                last_hello = std::chrono::steady_clock::now();
+            }
+            if (!port->waitReadable()) {
+                continue;
+            }
+            size_t count = port->read(chunk, std::min(port->available(), sizeof(chunk)));
+            for (size_t i = 0; i < count; i++) {
+                if (wt_receiver_push(&receiver, chunk[i], &frame) == WT_RX_FRAME && frame.type == WT_MSG_IDENT
+                    && frame.length == WT_IDENT_SIZE && wt_get_u32(frame.payload) == WT_IDENT_MAGIC) {
+                    return port;
+                }
+            }
+        }
+    } catch (const std::exception&) {
+        // Not a port we can use (missing, busy, or it went away)
+    }
+    return nullptr;
+}
+
+const char* message_name (uint8_t type) {
+    switch (type) {
+        case WT_MSG_SET_ANGLE: return "angle";
+        case WT_MSG_READ: return "read";
+        case WT_MSG_STREAM_START: return "stream_start";
+        case WT_MSG_STREAM_STOP: return "stream_stop";
+        case WT_MSG_HELLO: return "hello";
+        case WT_MSG_SET_BAUD: return "set_baud";
+        case WT_MSG_IDENT: return "ident";
+        case WT_MSG_SAMPLE: return "sample";
+        case WT_MSG_ACK: return "ack";
+        default: return "unknown";
+    }
+}
+
+SerialEngine::~SerialEngine() {
+    close();
+}
+
+bool SerialEngine::open(const std::string& name, unsigned long baud) {
+    close();
+    if (!claim_port(name)) {
+        std::cerr << "Error: " << name << " is already in use." << std::endl;
+        return false;
+    }
+    try {
+        port = std::make_unique<serial::Serial>(name, baud, io_timeout());
+    } catch (...) {
+        release_port(name);
+        throw;
+    }
+    if (!port->isOpen()) {
+        port.reset();
+        release_port(name);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(port_mutex);
+        port_name = name;
+    }
+    baud_rate = baud;
+    baud_ceiling = std::numeric_limits<unsigned long>::max();
+    link_baud = 0;
+    auto_select = false;
+    stream_active = false;
+
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        write_buffer.clear();
+        commands = {};
+        last_command_write = {};
+        written_measured_at = -1.0;
+    }
+    wt_receiver_reset(&receiver);
+    rx_seq = -1;
+    poll_pending = false;
+    clock.reset();
+    {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        error.clear();
+    }
+    link_state = LinkState::Connected;
+    running = true;
+    thread = std::thread(&SerialEngine::run, this);
+    return true;
+}
+
+void SerialEngine::connect(const std::string& preferred_port, unsigned long baud) {
+    close();
+    {
+        std::lock_guard<std::mutex> lock(port_mutex);
+        port_name = preferred_port;
+    }
+    baud_rate = baud;
+    baud_ceiling = std::numeric_limits<unsigned long>::max();
+    link_baud = 0;
+    auto_select = true;
+    stream_active = false;
+    link_state = LinkState::Searching;
+    running = true;
+    thread = std::thread(&SerialEngine::run, this);
+}
+
+void SerialEngine::close() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    release();
+    link_state = LinkState::Closed;
+}
+
+// Closes the port and gives it back to the other engines
+void SerialEngine::release() {
+    link_baud = 0;
+    if (port) {
+        port->close();
+        port.reset();
+        release_port(get_port());
+    }
+}
+
+std::string SerialEngine::get_port() const {
+    std::lock_guard<std::mutex> lock(port_mutex);
+    return port_name;
+}
+
+// Probes the candidate ports in parallel, one thread each, and keeps the first where the sketch answers (the others
+//   stop probing right away). Returns false if none did.
+bool SerialEngine::search() {
+    std::vector<std::string> candidates;
+    if (auto_select) {
+        try {
+            candidates = candidate_ports(get_port());
+        } catch (const std::exception& e) {
+            std::cerr << "Error: could not list the serial ports (" << e.what() << ")" << std::endl;
+        }
+    } else {
+        candidates.push_back(get_port());
+    }
+
+    std::mutex found_mutex;
+    std::atomic<bool> found{false};
+    std::string found_name;
+    std::vector<std::thread> probes;
+    for (const std::string& candidate : candidates) {
+        if (!claim_port(candidate)) {
+            continue; // another engine's
+        }
+        probes.emplace_back([&, candidate]() {
+            std::unique_ptr<serial::Serial> probed = probe_port(candidate, baud_rate, [&]() { return found || !running; });
+            std::lock_guard<std::mutex> lock(found_mutex);
+            if (probed && !found) {
+                found = true;
+                found_name = candidate;
+                port = std::move(probed);
+            } else {
+                release_port(candidate);
+            }
+        });
+    }
+    for (std::thread& probe : probes) {
+        probe.join();
+    }
+    if (!found) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(port_mutex);
+        port_name = found_name;
+    }
+    std::cout << "Wind tunnel found on " << found_name << std::endl;
+    return true;
+}
+
+// Writes one frame straight to the port, outside the write queue (only while nothing else is being sent: before a link
+//   is restored), and waits up to timeout for the reply: the WT_MSG_ACK of this frame, or a WT_MSG_IDENT. Every other
+//   frame is skipped. Corrupted frames seen meanwhile are added to errors.
+bool SerialEngine::request(uint8_t type, const uint8_t* payload, uint8_t length, uint8_t reply,
+                           std::chrono::milliseconds timeout, uint64_t& errors) {
+    uint8_t encoded[WT_MAX_ENCODED_SIZE];
+    uint8_t seq;
+    uint16_t size;
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        seq = tx_seq++;
+        size = wt_encode_frame(type, seq, payload, length, encoded);
+    }
+    bytes_sent += port->write(encoded, size);
+
+    WtReceiver replies;
+    wt_receiver_reset(&replies);
+    WtFrame frame;
+    uint8_t chunk[256];
+    const auto start = std::chrono::steady_clock::now();
+    while (running && std::chrono::steady_clock::now() - start < timeout) {
+        if (!port->waitReadable()) {
+            continue;
+        }
+        size_t count = port->read(chunk, std::min(port->available(), sizeof(chunk)));
+        bytes_received += count;
+        for (size_t i = 0; i < count; i++) {
+            int8_t status = wt_receiver_push(&replies, chunk[i], &frame);
+            if (status == WT_RX_ERROR) {
+                errors++;
+            } else if (status == WT_RX_FRAME && frame.type == reply) {
+                if (reply == WT_MSG_ACK && frame.length == WT_ACK_SIZE && frame.payload[0] == seq && frame.payload[1] == type) {
+                    return true;
+                }
+                if (reply == WT_MSG_IDENT && frame.length == WT_IDENT_SIZE && wt_get_u32(frame.payload) == WT_IDENT_MAGIC) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Whether the link works at the rate both ends just switched to. The first round trip may still see leftovers of the
+//   switch; the others must all arrive, and uncorrupted.
+bool SerialEngine::confirm_baud() {
+    for (int round = 0; round < NEGOTIATE_ROUNDS; round++) {
+        uint64_t errors = 0;
+        if (!request(WT_MSG_HELLO, nullptr, 0, WT_MSG_IDENT, NEGOTIATE_TIMEOUT, errors) || (round > 0 && errors > 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Goes (back) to the base rate and waits up to timeout until the device answers at it too: at once if it is there,
+//   otherwise once it has reverted (after a failed switch, or a link left at a faster rate) or finished starting up.
+//   Throws if it never answers, so the link is searched for.
+void SerialEngine::recover_base_baud(std::chrono::milliseconds timeout) {
+    port->setBaudrate(baud_rate);
+    port->flushInput();
+    const auto start = std::chrono::steady_clock::now();
+    while (running && std::chrono::steady_clock::now() - start < timeout) {
+        uint64_t errors = 0;
+        if (request(WT_MSG_HELLO, nullptr, 0, WT_MSG_IDENT, HELLO_INTERVAL, errors)) {
+            return;
+        }
+    }
+    throw std::runtime_error("the Arduino did not come back to " + std::to_string(baud_rate) + " baud");
+}
+
+// Raises the link rate, fastest candidate first, up to max_baud and below any rate that failed on this connection.
+//   Each rate is requested with WT_MSG_SET_BAUD (acknowledged at the current rate), then both ends switch and
+//   confirm_baud() decides whether to keep it; a rate that fails is abandoned on both ends and the next slower one is
+//   tried. A device that does not acknowledge the request (older firmware) stays at the base rate.
+//   Runs on the I/O thread between finding the Arduino and restoring the link. answered is whether the device has
+//   already answered at the base rate on this port (a probe found it). Returns the rate the link ended up at.
+unsigned long SerialEngine::negotiate_baud(bool answered) {
+    const unsigned long limit = std::min<unsigned long>(max_baud, baud_ceiling);
+    if (limit <= baud_rate) {
+        return baud_rate;
+    }
+    // A port just opened by open() has usually just reset the UNO, which needs the probe's whole startup budget to
+    //   answer; one that was not reset may still be at the rate of an earlier link until it reverts
+    if (!answered) {
+        recover_base_baud(PROBE_TIMEOUT);
+    }
+    // A device that was not reset may also still be streaming: its samples would crowd out the replies
+    uint64_t errors = 0;
+    request(WT_MSG_STREAM_STOP, nullptr, 0, WT_MSG_ACK, NEGOTIATE_TIMEOUT, errors);
+    port->flushInput();
+
+    for (unsigned long candidate : LINK_BAUD_RATES) {
+        if (candidate > limit || candidate <= baud_rate) {
+            continue;
+        }
+        uint8_t payload[WT_SET_BAUD_SIZE];
+        wt_put_u32(payload, static_cast<uint32_t>(candidate));
+        if (!request(WT_MSG_SET_BAUD, payload, sizeof(payload), WT_MSG_ACK, NEGOTIATE_TIMEOUT, errors)) {
+            std::cout << "The Arduino on " << get_port() << " did not accept " << candidate << " baud, staying at "
+                      << baud_rate << std::endl;
+            recover_base_baud(RECOVER_TIMEOUT); // in case only the acknowledgement was lost
+            return baud_rate;
+        }
+        try {
+            port->setBaudrate(candidate);
+        } catch (const std::exception& e) { // e.g. a port driver without this rate
+            std::cout << "The host cannot set " << get_port() << " to " << candidate << " baud (" << e.what() << ")" << std::endl;
+            recover_base_baud(RECOVER_TIMEOUT);
+            continue;
+        }
+        port->flushInput();
+        if (confirm_baud()) {
+            std::cout << "Link on " << get_port() << " raised to " << candidate << " baud" << std::endl;
+            return candidate;
+        }
+        std::cout << "Link on " << get_port() << " is unreliable at " << candidate << " baud, trying a slower rate" << std::endl;
+        recover_base_baud(RECOVER_TIMEOUT);
+    }
+    std::cout << "Link on " << get_port() << " stays at " << baud_rate << " baud" << std::endl;
+    return baud_rate;
+}
+
+// Above the base rate: keeps the link alive (see WT_KEEPALIVE_MS) and drops it, lowering the ceiling below the current
+//   rate, when too many frames arrive corrupted. Throws to drop the link, like a port error.
+void SerialEngine::check_link(std::chrono::steady_clock::time_point now) {
+    const unsigned long rate = link_baud;
+    if (rate <= baud_rate) {
+        return;
+    }
+    if (now - last_write >= KEEPALIVE_INTERVAL) {
+        send(WT_MSG_HELLO);
+    }
+    if (now - check_start < LINK_CHECK_INTERVAL) {
+        return;
+    }
+    const uint64_t frames = frames_received - check_frames;
+    const uint64_t corrupted = frames_corrupted - check_corrupted;
+    check_start = now;
+    check_frames = frames_received;
+    check_corrupted = frames_corrupted;
+    if (corrupted >= LINK_ERROR_MIN && corrupted > LINK_ERROR_RATIO * (frames + corrupted)) {
+        baud_ceiling = rate - 1;
+        baud_fallbacks++;
+        throw std::runtime_error(std::to_string(corrupted) + " of " + std::to_string(frames + corrupted)
+                                 + " frames corrupted at " + std::to_string(rate) + " baud, falling back to a slower rate");
+    }
+}
+
+// Starts a fresh link (the Arduino has usually just rebooted): drops whatever was queued for the old one and sends the
+//   angle and streaming mode the host had set
+void SerialEngine::restore_link() {
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        write_buffer.clear();
+        commands = {};
+        last_command_write = {};
+        written_measured_at = -1.0;
+    }
+    wt_receiver_reset(&receiver);
+    rx_seq = -1;
+    poll_pending = false;
+    clock.reset();
+    send_angle(angle);
+    if (stream_active) {
+        start_stream(stream_rate);
+    }
+}
+
+void SerialEngine::send(uint8_t type, const uint8_t* payload, uint8_t length) {
+    uint8_t encoded[WT_MAX_ENCODED_SIZE];
+    std::lock_guard<std::mutex> lock(write_mutex);
+    uint16_t size = wt_encode_frame(type, tx_seq++, payload, length, encoded);
+    write_buffer.insert(write_buffer.end(), encoded, encoded + size);
+}
+
+void SerialEngine::queue_command(uint8_t type, const uint8_t* payload, uint8_t length, double measured_at) {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    Command& command = commands[command_slot(type)];
+    if (command.pending) {
+        commands_coalesced++;
+    }
+    memcpy(command.payload, payload, length);
+    command.length = length;
+    command.pending = true;
+    command.awaiting_ack = false; // the older value no longer matters
+    command.retries = 0;
+    command.measured_at = measured_at;
+}
+
+void SerialEngine::send_angle(int16_t value, double measured_at) {
+    uint8_t payload[WT_SET_ANGLE_SIZE];
+    wt_put_i16(payload, value);
+    angle = value;
+    queue_command(WT_MSG_SET_ANGLE, payload, sizeof(payload), measured_at);
+}
+
+void SerialEngine::start_stream(uint16_t rate) {
+    stream_active = true;
+    stream_rate = rate;
+    uint8_t payload[WT_STREAM_START_SIZE];
+    wt_put_u16(payload, rate);
+    send(WT_MSG_STREAM_START, payload, sizeof(payload));
+}
+
+void SerialEngine::stop_stream() {
+    stream_active = false;
+    send(WT_MSG_STREAM_STOP);
+}
+
+std::string SerialEngine::get_error() const {
+    std::lock_guard<std::mutex> lock(error_mutex);
+    return error;
+}
+
+int SerialEngine::get_commands_unacked() const {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    int count = 0;
+    for (const Command& command : commands) {
+        if (command.pending || command.awaiting_ack) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Appends every pending (or unacknowledged and timed out) command to write_buffer, at most command_rate times per
+//   second (new closed-loop setpoints go out at once). Called with write_mutex held, after the direct frames, so
+//   reads never wait behind setpoints.
+void SerialEngine::encode_commands(std::chrono::steady_clock::time_point now) {
+    const unsigned rate = command_rate;
+    const bool limited = rate > 0 && now - last_command_write < std::chrono::microseconds(1000000 / rate);
+    bool wrote = false;
+    for (size_t i = 0; i < COMMAND_KEYS; i++) {
+        Command& command = commands[i];
+        if (limited && !(command.pending && command.measured_at >= 0.0)) {
+            continue;
+        }
+        const bool resend = !command.pending && command.awaiting_ack && now - command.sent > ACK_TIMEOUT;
+        if (resend && command.retries >= COMMAND_RETRIES) {
+            std::cerr << "Error: " << message_name(COMMAND_TYPES[i]) << " was never acknowledged." << std::endl;
+            command.awaiting_ack = false;
+            commands_failed++;
+            continue;
+        }
+        if (!command.pending && !resend) {
+            continue;
+        }
+
+        uint8_t encoded[WT_MAX_ENCODED_SIZE];
+        command.seq = tx_seq++;
+        uint16_t size = wt_encode_frame(COMMAND_TYPES[i], command.seq, command.payload, command.length, encoded);
+        // Nothing is printed here: this runs under write_mutex on the I/O thread, in the closed loop's sense-to-actuate
+        //   path (the commands_* counters and command_rtt cover what was sent)
+        write_buffer.insert(write_buffer.end(), encoded, encoded + size);
+        if (resend) {
+            command.retries++;
+            commands_resent++;
+        } else if (command.measured_at >= 0.0) {
+            written_measured_at = command.measured_at;
+        }
+        command.pending = false;
+        command.awaiting_ack = true;
+        command.sent = now;
+        wrote = true;
+    }
+    if (wrote) {
+        last_command_write = now;
+    }
+}
+
+void SerialEngine::acknowledge(const WtFrame& frame) {
+    if (frame.length != WT_ACK_SIZE) {
+        return;
+    }
+    int slot = command_slot(frame.payload[1]);
+    if (slot < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(write_mutex);
+    Command& command = commands[slot];
+    if (command.awaiting_ack && command.seq == frame.payload[0]) {
+        command.awaiting_ack = false;
+        commands_acked++;
+        command_rtt.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - command.sent).count());
+    }
+}
+
+void SerialEngine::flush_writes() {
+    std::vector<uint8_t> pending;
+    double measured_at;
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        encode_commands(std::chrono::steady_clock::now());
+        pending.swap(write_buffer);
+        measured_at = written_measured_at;
+        written_measured_at = -1.0;
+    }
+    if (!pending.empty()) {
+        bytes_sent += port->write(pending);
+        last_write = std::chrono::steady_clock::now();
+        if (measured_at >= 0.0) {
+            control_latency.record(static_cast<uint64_t>(std::max(0.0, host_time() - measured_at) * 1e6));
+        }
+    }
+}
+
+void SerialEngine::receive(const uint8_t* data, size_t size) {
+    const auto start = std::chrono::steady_clock::now();
+    WtFrame frame;
+    for (size_t i = 0; i < size; i++) {
+        int8_t status = wt_receiver_push(&receiver, data[i], &frame);
+        if (status == WT_RX_ERROR) {
+            frames_corrupted++;
+        } else if (status == WT_RX_FRAME) {
+            frames_received++;
+            if (rx_seq >= 0) {
+                frames_lost += static_cast<uint8_t>(frame.seq - static_cast<uint8_t>(rx_seq + 1));
+            }
+            rx_seq = frame.seq;
+            if (frame.type == WT_MSG_SAMPLE) {
+                if (poll_pending) {
+                    read_rtt.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - poll_sent).count());
+                }
+                poll_pending = false;
+            } else if (frame.type == WT_MSG_ACK) {
+                acknowledge(frame);
+            }
+            if (frame_handler) {
+                frame_handler(frame);
+            }
+        }
+    }
+    if (chunk_handler) {
+        chunk_handler();
+    }
+    parse_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void SerialEngine::run() {
+    std::vector<uint8_t> chunk(READ_CHUNK_SIZE);
+    auto search_start = std::chrono::steady_clock::now();
+    bool dropped = false;
+    bool fresh = static_cast<bool>(port); // opened by open(): negotiated like a found port, with nothing to restore
+    bool found = false;
+    while (running) {
+        if (!port) {
+            link_state = LinkState::Searching;
+            if (!search()) {
+                for (auto waited = std::chrono::milliseconds(0); running && waited < SEARCH_INTERVAL; waited += SEARCH_STEP) {
+                    std::this_thread::sleep_for(SEARCH_STEP);
+                }
+                continue;
+            }
+            search_time.record(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - search_start).count());
+            if (dropped) {
+                reconnects++;
+            }
+            fresh = true;
+            found = true;
+        }
+        try {
+            if (fresh) {
+                fresh = false;
+                link_baud = negotiate_baud(found);
+                if (found) {
+                    restore_link();
+                }
+                check_start = last_write = std::chrono::steady_clock::now();
+                check_frames = frames_received;
+                check_corrupted = frames_corrupted;
+                link_state = LinkState::Connected;
+            }
+            io_loop(chunk);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                error = e.what();
+            }
+            // The port is gone (e.g. the cable was pulled), so the Arduino is searched for again
+            std::cout << "Lost the link on " << get_port() << ", searching again" << std::endl;
+            release();
+            dropped = true;
+            search_start = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+// Services the port until close() (returns) or until the link fails (throws)
+void SerialEngine::io_loop(std::vector<uint8_t>& chunk) {
+    while (running) {
+        if (polling && (!poll_pending || std::chrono::steady_clock::now() - poll_sent > POLL_TIMEOUT)) {
+            send(WT_MSG_READ);
+            poll_pending = true;
+            poll_sent = std::chrono::steady_clock::now();
+        }
+        check_link(std::chrono::steady_clock::now());
+        flush_writes();
+
+        // Blocks in select() on the port until bytes arrive or IO_POLL_MS passes
+        if (!port->waitReadable()) {
+            continue;
+        }
+        size_t available = port->available();
+        if (available == 0) {
+            continue;
+        }
+        size_t count = port->read(chunk.data(), std::min(available, chunk.size()));
+        bytes_received += count;
+        receive(chunk.data(), count);
+    }
+}
@@ -0,0 +1,220 @@
+// Serial I/O Engine
+//   A single long-lived thread owns the serial port. It waits for incoming bytes, reads them in large chunks,
+//   reassembles protocol frames, and performs every write queued by the rest of the program,
+//   so the GUI never blocks on (or even touches) the port.
+//
+// Setpoints (the angle) go through a keyed command queue: only the newest value per key is
+//   kept, the pending keys are sent together in one write at most command_rate times per second, and each is resent
+//   until the Arduino acknowledges it (WT_MSG_ACK). Reads and stream commands bypass the queue, so they are never
+//   stuck behind stale setpoints.
+//
+// The I/O thread also finds the Arduino and keeps the link up. connect() returns at once and probes the candidate
+//   ports in parallel on the I/O thread: each is opened and sent WT_MSG_HELLO until a device answers with
+//   WT_MSG_IDENT, and the first to answer is kept. When the link drops, the port is probed again (with connect(), all
+//   candidates are) until the Arduino is back, then the angle and streaming mode it had are restored. Ports in use by
+//   one engine are never probed by another.
+//
+// Once the Arduino is found, the link rate is raised as far as max_baud allows (see negotiate_baud() and "Link speed" in
+//   wt_protocol.h): each faster rate is kept only if a burst of round trips at it comes back clean. If frames then
+//   start arriving corrupted, the link is dropped and renegotiated below the rate that failed.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "serial/serial.h"
+#include "wt_protocol.h"
+#include "config.h"
+#include "device_clock.h"
+#include "histogram.h"
+
+const char* message_name (uint8_t type);
+
+const unsigned BASE_COMMAND_RATE = 30; // keyed command writes per second
+
+enum class LinkState { Closed, Searching, Connected };
+const char* link_state_name (LinkState state);
+
+class SerialEngine {
+public:
+    // Called on the I/O thread for every valid frame received from the Arduino
+    using FrameHandler = std::function<void(const WtFrame&)>;
+    // Called on the I/O thread after every frame of one read was handled, so frames can be processed in blocks
+    using ChunkHandler = std::function<void()>;
+
+    SerialEngine() = default;
+    ~SerialEngine();
+
+    SerialEngine(const SerialEngine&) = delete;
+    SerialEngine& operator=(const SerialEngine&) = delete;
+
+    // Opens the port and starts the I/O thread. Throws serial::IOException if the port cannot be opened.
+    //   If the link drops, the I/O thread waits for the Arduino to come back on the same port.
+    bool open(const std::string& port, unsigned long baud);
+    // Starts the I/O thread, which looks for the Arduino on preferred_port (if not empty) and every USB serial port in
+    //   parallel, and looks again whenever the link drops. Returns immediately; see get_link_state().
+    void connect(const std::string& preferred_port, unsigned long baud);
+    void close();
+    // True from open()/connect() until close(), including while the link is down and being searched for
+    bool is_open() const { return running; }
+    bool is_connected() const { return link_state == LinkState::Connected; }
+    LinkState get_link_state() const { return link_state; }
+    // Port of the current (or last) link
+    std::string get_port() const;
+
+    // Must be set before open()
+    void set_frame_handler(FrameHandler handler) { frame_handler = std::move(handler); }
+    void set_chunk_handler(ChunkHandler handler) { chunk_handler = std::move(handler); }
+
+    // Request/response mode: the I/O thread sends WT_MSG_READ as soon as the previous sample arrived
+    void set_polling(bool enabled) { polling = enabled; }
+
+    // Queues a frame for the I/O thread. Frames queued back-to-back are sent in the same write.
+    void send(uint8_t type, const uint8_t* payload = nullptr, uint8_t length = 0);
+
+    // Fastest link rate to negotiate after connecting (the open()/connect() rate: never faster). Applies to the next
+    //   link, i.e. after a reconnect.
+    void set_max_baud(unsigned long baud) { max_baud = baud; }
+    unsigned long get_max_baud() const { return max_baud; }
+    // Rate of the current link (0 while there is none, or while it is being negotiated)
+    unsigned long get_baud() const { return link_baud; }
+
+    // Maximum number of keyed command writes per second (0 = every I/O cycle)
+    void set_command_rate(unsigned rate) { command_rate = rate; }
+    unsigned get_command_rate() const { return command_rate; }
+
+    // Command helpers. Setpoints (the angle) are coalesced in the command queue; streaming is sent like send().
+    //   Calibration and taring happen on the host (see calibration.h), so they are not commands.
+    //   A closed-loop angle passes measured_at, the host time of the sample it was computed from: it is not held back
+    //   by the command rate (the controller paces itself), and its sense-to-actuate latency is recorded.
+    void send_angle(int16_t value, double measured_at = -1.0);
+    void start_stream(uint16_t rate);
+    void stop_stream();
+
+    // Statistics (readable from any thread)
+    uint64_t get_frames_received() const { return frames_received; }
+    uint64_t get_frames_corrupted() const { return frames_corrupted; }
+    uint64_t get_frames_lost() const { return frames_lost; }
+    uint64_t get_bytes_received() const { return bytes_received; }
+    uint64_t get_bytes_sent() const { return bytes_sent; }
+    uint64_t get_commands_coalesced() const { return commands_coalesced; } // replaced by a newer value before sending
+    uint64_t get_commands_acked() const { return commands_acked; }
+    uint64_t get_commands_resent() const { return commands_resent; }
+    uint64_t get_commands_failed() const { return commands_failed; } // never acknowledged
+    uint64_t get_reconnects() const { return reconnects; }
+    uint64_t get_baud_fallbacks() const { return baud_fallbacks; } // links dropped for corrupted frames at a raised rate
+    int get_commands_unacked() const; // sent or pending, not acknowledged yet
+
+    // Timing (recorded on the I/O thread, readable from any thread)
+    const Histogram& get_command_rtt() const { return command_rtt; } // command written -> acknowledged
+    const Histogram& get_read_rtt() const { return read_rtt; }       // WT_MSG_READ written -> sample received
+    const Histogram& get_parse_time() const { return parse_time; }   // reassembling and handling one read
+    const Histogram& get_search_time() const { return search_time; } // link down (or connect()) -> Arduino identified
+    const Histogram& get_control_latency() const { return control_latency; } // sample measured -> closed-loop angle written
+    std::string get_error() const;
+    // Last angle sent with send_angle() (the servo's setpoint)
+    int16_t get_angle() const { return angle; }
+
+    // Maps device timestamps of this connection to host time. map() may only be called from the frame handler;
+    //   the estimates can be read from any thread. Reset by open().
+    DeviceClock& get_clock() { return clock; }
+    const DeviceClock& get_clock() const { return clock; }
+
+private:
+    // One slot per setpoint key (see command_slot)
+    struct Command {
+        uint8_t payload[WT_MAX_PAYLOAD];
+        uint8_t length = 0;
+        bool pending = false;      // newer value not sent yet
+        bool awaiting_ack = false;
+        uint8_t seq = 0;
+        uint8_t retries = 0;
+        std::chrono::steady_clock::time_point sent;
+        double measured_at = -1.0; // closed-loop setpoints only, see send_angle()
+    };
+    static const size_t COMMAND_KEYS = 1;
+
+    void queue_command(uint8_t type, const uint8_t* payload, uint8_t length, double measured_at = -1.0);
+    void encode_commands(std::chrono::steady_clock::time_point now);
+    void acknowledge(const WtFrame& frame);
+    void run();
+    void flush_writes();
+    void receive(const uint8_t* data, size_t size);
+    void io_loop(std::vector<uint8_t>& chunk);
+    bool search();
+    unsigned long negotiate_baud(bool answered);
+    bool request(uint8_t type, const uint8_t* payload, uint8_t length, uint8_t reply, std::chrono::milliseconds timeout,
+                 uint64_t& errors);
+    bool confirm_baud();
+    void recover_base_baud(std::chrono::milliseconds timeout);
+    void check_link(std::chrono::steady_clock::time_point now);
+    void restore_link();
+    void release();
+
+    std::unique_ptr<serial::Serial> port;
+    mutable std::mutex port_mutex;
+    std::string port_name;          // guarded by port_mutex
+    unsigned long baud_rate = BAUD;    // the rate every link starts at
+    std::atomic<unsigned long> max_baud{MAX_BAUD};
+    std::atomic<unsigned long> link_baud{0};
+    unsigned long baud_ceiling = 0;    // lowered below a rate that failed (I/O thread only, reset by open()/connect())
+    bool auto_select = false;       // search every candidate port, not just port_name
+    std::atomic<LinkState> link_state{LinkState::Closed};
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> polling{false};
+    FrameHandler frame_handler;
+    ChunkHandler chunk_handler;
+
+    // Outbound frames, encoded on the caller's thread and written by the I/O thread
+    mutable std::mutex write_mutex;
+    std::vector<uint8_t> write_buffer;
+    uint8_t tx_seq = 0;
+    std::array<Command, COMMAND_KEYS> commands; // guarded by write_mutex
+    std::chrono::steady_clock::time_point last_command_write;
+    std::chrono::steady_clock::time_point last_write; // I/O thread only, for the keepalive
+    double written_measured_at = -1.0; // closed-loop setpoint in write_buffer, if any
+    std::atomic<unsigned> command_rate{BASE_COMMAND_RATE};
+
+    // Inbound state (I/O thread only)
+    WtReceiver receiver{};
+    int rx_seq = -1;
+    bool poll_pending = false;
+    std::chrono::steady_clock::time_point poll_sent;
+    DeviceClock clock;
+    std::chrono::steady_clock::time_point check_start; // error rate window of check_link()
+    uint64_t check_frames = 0;
+    uint64_t check_corrupted = 0;
+
+    std::atomic<int16_t> angle{BASE_ANGLE};
+    std::atomic<bool> stream_active{false}; // streaming mode, restored after a reconnect
+    std::atomic<uint16_t> stream_rate{0};
+    std::atomic<uint64_t> frames_received{0};
+    std::atomic<uint64_t> frames_corrupted{0};
+    std::atomic<uint64_t> frames_lost{0};
+    std::atomic<uint64_t> bytes_received{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> commands_coalesced{0};
+    std::atomic<uint64_t> commands_acked{0};
+    std::atomic<uint64_t> commands_resent{0};
+    std::atomic<uint64_t> commands_failed{0};
+    std::atomic<uint64_t> reconnects{0};
+    std::atomic<uint64_t> baud_fallbacks{0};
+    Histogram command_rtt{"command round trip", "us"};
+    Histogram read_rtt{"read round trip", "us"};
+    Histogram parse_time{"frame parse per read", "ns"};
+    Histogram search_time{"port search", "ms"};
+    Histogram control_latency{"control sense to actuate", "us"};
+
+    mutable std::mutex error_mutex;
+    std::string error;
+};
@@ -0,0 +1,196 @@
+#include "signal_stage.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Sample rate measurement period (in sample time), and how far it may move before the filters are redesigned
+const double RATE_PERIOD = 1.0;
+const double RATE_TOLERANCE = 0.1;
+// Raw samples averaged by a tare
+const uint64_t TARE_SAMPLES = 40;
+
+const char* filter_name (FilterType type) {
+    switch (type) {
+        case FilterType::None: return "None";
+        case FilterType::LowPassBiquad: return "Low-pass (biquad)";
+        case FilterType::LowPassFir: return "Low-pass (FIR)";
+        case FilterType::Notch: return "Notch";
+        default: return "unknown";
+    }
+}
+
+void SignalStage::configure(const FilterSettings& new_settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    settings = new_settings;
+    redesign = true;
+}
+
+FilterSettings SignalStage::get_settings() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return settings;
+}
+
+void SignalStage::reset_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    reset_requested = true;
+}
+
+void SignalStage::set_calibration(const Calibration& new_calibration) {
+    std::lock_guard<std::mutex> lock(mutex);
+    calibration = new_calibration;
+    calibration_changed = true;
+}
+
+Calibration SignalStage::get_calibration() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return calibration;
+}
+
+void SignalStage::tare(uint8_t mask) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tare_requested |= mask;
+}
+
+bool SignalStage::is_taring() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (tare_requested | tare_mask) != 0;
+}
+
+void SignalStage::get_stats(ChannelStats& v, ChannelStats& h) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    v = stats_v;
+    h = stats_h;
+}
+
+double SignalStage::get_sample_rate() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sample_rate;
+}
+
+void SignalStage::Channel::design(const FilterSettings& settings, double rate) {
+    // Keeps the frequency above 0 and below Nyquist and Q positive, so the designs stay finite and stable for any input
+    const double frequency = std::clamp(settings.frequency, MIN_FILTER_FREQUENCY * rate, MAX_FILTER_FREQUENCY * rate);
+    const double q = std::max(settings.q, MIN_FILTER_Q);
+    biquad = settings.type == FilterType::Notch ? Biquad::notch(rate, frequency, q)
+                                                : Biquad::lowpass(rate, frequency, q);
+    fir = FirFilter::lowpass(rate, frequency, static_cast<size_t>(std::clamp(settings.fir_taps, MIN_FIR_TAPS, MAX_FIR_TAPS)));
+    if (window.get_length() != static_cast<size_t>(std::max(settings.window, 1))) {
+        window.set_length(static_cast<size_t>(std::max(settings.window, 1)));
+    }
+}
+
+void SignalStage::Channel::filter(FilterType type, size_t count) {
+    switch (type) {
+        case FilterType::LowPassBiquad:
+        case FilterType::Notch:
+            biquad.process(input.data(), output.data(), count);
+            break;
+        case FilterType::LowPassFir:
+            fir.process(input.data(), output.data(), count);
+            break;
+        default:
+            std::copy(input.begin(), input.begin() + count, output.begin());
+            break;
+    }
+    for (size_t i = 0; i < count; i++) {
+        running.add(input[i]);
+        window.add(output[i]);
+    }
+}
+
+void SignalStage::Channel::summarize(ChannelStats& stats) const {
+    stats.count = running.get_count();
+    stats.mean = running.get_mean();
+    stats.stddev = running.get_stddev();
+    stats.window_mean = window.get_mean();
+    stats.window_min = window.get_min();
+    stats.window_max = window.get_max();
+}
+
+void SignalStage::measure_rate(const Sample* block, size_t count) {
+    if (rate_start < 0.0 || block[0].t < rate_start) { // first block, or a replay seeked backwards
+        rate_start = block[0].t;
+        rate_count = 0;
+    }
+    rate_count += count;
+    const double elapsed = block[count - 1].t - rate_start;
+    if (elapsed >= RATE_PERIOD) {
+        sample_rate = (rate_count - 1) / elapsed;
+        rate_start = block[count - 1].t;
+        rate_count = 1;
+    }
+}
+
+void SignalStage::process(Sample* block, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        measure_rate(block, count);
+        if (reset_requested) {
+            channel_v.running.reset();
+            channel_h.running.reset();
+            channel_v.window.reset();
+            channel_h.window.reset();
+            reset_requested = false;
+        }
+        if (calibration_changed) {
+            active_calibration = calibration;
+            calibration_changed = false;
+        }
+        if (tare_requested) {
+            tare_mask |= tare_requested;
+            tare_requested = 0;
+            tare_v.reset();
+            tare_h.reset();
+        }
+        if (sample_rate > 0.0 && (redesign || std::fabs(sample_rate - designed_rate) > RATE_TOLERANCE * designed_rate)) {
+            channel_v.design(settings, sample_rate);
+            channel_h.design(settings, sample_rate);
+            active = settings.type;
+            designed_rate = sample_rate;
+            redesign = false;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        active_calibration.apply(block[i]);
+    }
+    if (tare_mask) {
+        for (size_t i = 0; i < count; i++) {
+            tare_v.add(block[i].raw_v);
+            tare_h.add(block[i].raw_h);
+        }
+        if (tare_v.get_count() >= TARE_SAMPLES) {
+            if (tare_mask & CHANNEL_V) active_calibration.offset_v = tare_v.get_mean();
+            if (tare_mask & CHANNEL_H) active_calibration.offset_h = tare_h.get_mean();
+            std::lock_guard<std::mutex> lock(mutex);
+            calibration.offset_v = active_calibration.offset_v;
+            calibration.offset_h = active_calibration.offset_h;
+            tare_mask = 0;
+        }
+    }
+
+    // Until the sample rate is known, the samples pass through unfiltered
+    channel_v.input.resize(count);
+    channel_h.input.resize(count);
+    channel_v.output.resize(count);
+    channel_h.output.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        channel_v.input[i] = block[i].v;
+        channel_h.input[i] = block[i].h;
+    }
+    const FilterType type = designed_rate > 0.0 ? active : FilterType::None;
+    channel_v.filter(type, count);
+    channel_h.filter(type, count);
+    for (size_t i = 0; i < count; i++) {
+        block[i].v_filtered = channel_v.output[i];
+        block[i].h_filtered = channel_h.output[i];
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    channel_v.summarize(stats_v);
+    channel_h.summarize(stats_h);
+}
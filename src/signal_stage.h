@@ -0,0 +1,104 @@
+// Signal Processing Stage
+//   Runs on the acquisition thread (the serial engine's I/O thread, or the replay thread) before samples are handed
+//   to the render loop. Each block of samples is calibrated (raw counts to forces, see calibration.h), filtered per
+//   channel (filling Sample::v_filtered/h_filtered) and summarized: running mean/stddev of the raw values since the last reset (Welford) and mean/min/max of the
+//   filtered values over a rolling window.
+//   The GUI changes settings and reads statistics from its own thread; both go through a mutex taken once per block.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "calibration.h"
+#include "filters.h"
+#include "sample.h"
+#include "stats.h"
+
+enum class FilterType { None, LowPassBiquad, LowPassFir, Notch };
+
+struct FilterSettings {
+    FilterType type = FilterType::None;
+    double frequency = 5.0;   // cutoff (low-pass) or center (notch) in Hz, MIN_FILTER_FREQUENCY to MAX_FILTER_FREQUENCY
+    double q = 0.7071;        // biquad quality factor, at least MIN_FILTER_Q
+    int fir_taps = 63;        // MIN_FIR_TAPS to MAX_FIR_TAPS
+    int window = 80;          // rolling window length in samples
+};
+
+// FIR tap bounds: the Hamming window is undefined below 3 taps
+const int MIN_FIR_TAPS = 3;
+const int MAX_FIR_TAPS = 1023;
+// Frequency bounds as fractions of the sample rate: 0 Hz zeroes every FIR tap, and the designs need to stay below Nyquist
+const double MIN_FILTER_FREQUENCY = 0.01;
+const double MAX_FILTER_FREQUENCY = 0.45;
+// A Q of 0 makes the biquad's bandwidth term infinite, a negative one makes it unstable
+const double MIN_FILTER_Q = 0.1;
+
+struct ChannelStats {
+    uint64_t count = 0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    double window_mean = 0.0;
+    float window_min = 0.0f;
+    float window_max = 0.0f;
+};
+
+const char* filter_name (FilterType type);
+
+class SignalStage {
+public:
+    // Thread-safe. The filters are (re)designed on the acquisition thread once the sample rate is known.
+    void configure(const FilterSettings& settings);
+    FilterSettings get_settings() const;
+    void reset_stats();
+
+    // Thread-safe. The calibration applies from the next block on. tare() sets the offsets of the channels in mask
+    //   (CHANNEL_V | CHANNEL_H) to their mean raw counts over the next TARE_SAMPLES samples.
+    void set_calibration(const Calibration& calibration);
+    Calibration get_calibration() const;
+    void tare(uint8_t mask);
+    bool is_taring() const;
+
+    // Acquisition thread only
+    void process(Sample* block, size_t count);
+
+    // Snapshot of the statistics as of the last processed block (any thread)
+    void get_stats(ChannelStats& v, ChannelStats& h) const;
+    double get_sample_rate() const;
+
+private:
+    struct Channel {
+        Biquad biquad;
+        FirFilter fir;
+        RunningStats running;
+        RollingWindow window;
+        std::vector<float> input, output;
+
+        void design(const FilterSettings& settings, double sample_rate);
+        void filter(FilterType type, size_t count);
+        void summarize(ChannelStats& stats) const;
+    };
+
+    void measure_rate(const Sample* block, size_t count);
+
+    mutable std::mutex mutex;
+    FilterSettings settings;
+    bool redesign = true;
+    bool reset_requested = false;
+    Calibration calibration;
+    bool calibration_changed = true;
+    uint8_t tare_requested = 0;
+    uint8_t tare_mask = 0; // channels being tared (only the acquisition thread writes it, under the mutex)
+    ChannelStats stats_v, stats_h;
+    double sample_rate = 0.0;
+
+    // Acquisition thread only
+    Calibration active_calibration;
+    RunningStats tare_v, tare_h;
+    Channel channel_v, channel_h;
+    FilterType active = FilterType::None;
+    double designed_rate = 0.0;
+    double rate_start = -1.0;
+    uint64_t rate_count = 0;
+};
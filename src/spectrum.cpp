@@ -0,0 +1,411 @@
+#include "spectrum.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+const double PI = 3.14159265358979323846;
+const size_t INPUT_CAPACITY = 1 << 16;         // samples between the render loop and the worker
+const size_t INPUT_BLOCK = 1024;
+const auto WORKER_TIMEOUT = std::chrono::milliseconds(20); // bounds the wait if a wake-up is missed
+const double MAX_GAP = 1.0;                    // seconds between samples before the analysis restarts
+const size_t MAX_PEAK_LOG = 10000;
+const double PEAK_MOVE_BINS = 2.0;             // a dominant peak is logged again once it moves this far
+const int MIN_SPECTROGRAM_ROWS = 10;
+const int MAX_SPECTROGRAM_ROWS = 2000;
+const float POWER_FLOOR = 1e-20f;              // -200 dB, keeps log10 finite on an all-zero channel
+
+const char* spectrum_window_name (SpectrumWindow window) {
+    switch (window) {
+        case SpectrumWindow::Rectangular: return "Rectangular";
+        case SpectrumWindow::Hann: return "Hann";
+        case SpectrumWindow::Hamming: return "Hamming";
+        case SpectrumWindow::BlackmanHarris: return "Blackman-Harris";
+    }
+    return "Unknown";
+}
+
+namespace {
+
+double window_value (SpectrumWindow window, size_t i, size_t n) {
+    const double x = 2.0 * PI * i / n; // periodic windows, as usual for spectral analysis
+    switch (window) {
+        case SpectrumWindow::Hann: return 0.5 - 0.5 * std::cos(x);
+        case SpectrumWindow::Hamming: return 0.54 - 0.46 * std::cos(x);
+        case SpectrumWindow::BlackmanHarris:
+            return 0.35875 - 0.48829 * std::cos(x) + 0.14128 * std::cos(2.0 * x) - 0.01168 * std::cos(3.0 * x);
+        default: return 1.0;
+    }
+}
+
+SpectrumSettings clamp_settings (SpectrumSettings settings) {
+    int size = MIN_SPECTRUM_SIZE;
+    while (size < settings.size && size < MAX_SPECTRUM_SIZE) {
+        size <<= 1;
+    }
+    settings.size = size;
+    settings.overlap = std::clamp(settings.overlap, 0, 95);
+    settings.peak_threshold = std::max(0.0, settings.peak_threshold);
+    settings.history = std::clamp(settings.history, MIN_SPECTROGRAM_ROWS, MAX_SPECTROGRAM_ROWS);
+    return settings;
+}
+
+}
+
+Fft::Fft(size_t size) : n(size) {
+    if (n < 2) {
+        return;
+    }
+    int bits = 0;
+    while ((size_t(1) << bits) < n) {
+        bits++;
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t j = 0;
+        for (int b = 0; b < bits; b++) {
+            j |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        if (i < j) {
+            swaps.push_back(static_cast<uint32_t>(i));
+            swaps.push_back(static_cast<uint32_t>(j));
+        }
+    }
+    twiddle_re.resize(n - 1);
+    twiddle_im.resize(n - 1);
+    for (size_t m = 1; m < n; m <<= 1) {
+        for (size_t j = 0; j < m; j++) {
+            twiddle_re[m - 1 + j] = static_cast<float>(std::cos(PI * j / m));
+            twiddle_im[m - 1 + j] = static_cast<float>(-std::sin(PI * j / m));
+        }
+    }
+}
+
+// m butterflies between a and b = a + m. The arrays never overlap, which lets the compiler vectorize the loop.
+static void butterflies (float* __restrict ar, float* __restrict ai, float* __restrict br, float* __restrict bi,
+                         const float* __restrict wr, const float* __restrict wi, size_t m) {
+    for (size_t j = 0; j < m; j++) {
+        const float tr = wr[j] * br[j] - wi[j] * bi[j];
+        const float ti = wr[j] * bi[j] + wi[j] * br[j];
+        br[j] = ar[j] - tr;
+        bi[j] = ai[j] - ti;
+        ar[j] += tr;
+        ai[j] += ti;
+    }
+}
+
+void Fft::transform(float* re, float* im) const {
+    for (size_t s = 0; s < swaps.size(); s += 2) {
+        std::swap(re[swaps[s]], re[swaps[s + 1]]);
+        std::swap(im[swaps[s]], im[swaps[s + 1]]);
+    }
+    // Stages of half size m: each butterfly loop runs over m contiguous pairs and m contiguous twiddles
+    for (size_t m = 1; m < n; m <<= 1) {
+        const float* wr = twiddle_re.data() + m - 1;
+        const float* wi = twiddle_im.data() + m - 1;
+        for (size_t k = 0; k < n; k += 2 * m) {
+            butterflies(re + k, im + k, re + k + m, im + k + m, wr, wi, m);
+        }
+    }
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer() : input(INPUT_CAPACITY) {}
+
+SpectrumAnalyzer::~SpectrumAnalyzer() {
+    stop();
+}
+
+void SpectrumAnalyzer::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        return;
+    }
+    running = true;
+    worker = std::thread(&SpectrumAnalyzer::run, this);
+}
+
+void SpectrumAnalyzer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void SpectrumAnalyzer::configure(const SpectrumSettings& new_settings) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        settings = clamp_settings(new_settings);
+        reconfigure = true;
+    }
+    wake.notify_one();
+}
+
+SpectrumSettings SpectrumAnalyzer::get_settings() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return settings;
+}
+
+void SpectrumAnalyzer::add(const Sample* block, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        input.push({block[i].t, block[i].v, block[i].h});
+    }
+    if (count > 0) {
+        wake.notify_one();
+    }
+}
+
+void SpectrumAnalyzer::get_view(SpectrumView& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (out.transforms != view.transforms || out.bins != view.bins) {
+        out = view;
+    }
+}
+
+std::vector<SpectralPeak> SpectrumAnalyzer::get_peak_log() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::vector<SpectralPeak>(peak_log.begin(), peak_log.end());
+}
+
+void SpectrumAnalyzer::clear_peak_log() {
+    std::lock_guard<std::mutex> lock(mutex);
+    peak_log.clear();
+}
+
+bool SpectrumAnalyzer::export_peaks(const std::string& path) const {
+    const std::vector<SpectralPeak> peaks = get_peak_log();
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: could not open " << path << " for writing." << std::endl;
+        return false;
+    }
+    file << "time_s,channel,frequency_hz,magnitude_db\n";
+    file << std::setprecision(8);
+    for (const SpectralPeak& p : peaks) {
+        file << p.t << ',' << (p.channel == 0 ? "vertical" : "horizontal") << ',' << p.frequency << ',' << p.magnitude << '\n';
+    }
+    std::cout << "Spectral peaks saved to " << path << std::endl;
+    return true;
+}
+
+void SpectrumAnalyzer::run() {
+    Input block[INPUT_BLOCK];
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        if (reconfigure) {
+            active = settings;
+            reconfigure = false;
+            lock.unlock();
+            rebuild();
+            lock.lock();
+        }
+        lock.unlock();
+        size_t count;
+        while ((count = input.pop(block, INPUT_BLOCK)) > 0) {
+            for (size_t i = 0; i < count; i++) {
+                push(block[i]);
+            }
+        }
+        lock.lock();
+        // add() notifies without the mutex, so a wake-up can slip past the check; the timeout picks those samples up
+        wake.wait_for(lock, WORKER_TIMEOUT, [this] { return !running || reconfigure || input.size() > 0; });
+    }
+}
+
+// Sizes everything for the active settings (worker thread)
+void SpectrumAnalyzer::rebuild() {
+    const size_t n = static_cast<size_t>(active.size);
+    fft = Fft(n);
+    window.resize(n);
+    window_gain = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        window[i] = static_cast<float>(window_value(active.window, i, n));
+        window_gain += window[i];
+    }
+    history_t.assign(n, 0.0);
+    history_v.assign(n, 0.0f);
+    history_h.assign(n, 0.0f);
+    hop = std::max<size_t>(1, n * static_cast<size_t>(100 - active.overlap) / 100);
+    re.resize(n);
+    im.resize(n);
+    for (std::vector<float>& m : magnitude) {
+        m.resize(n / 2 + 1);
+    }
+    restart();
+}
+
+// Forgets the buffered samples and the spectrogram, e.g. after a gap in the data (worker thread)
+void SpectrumAnalyzer::restart() {
+    history_next = 0;
+    history_count = 0;
+    since_transform = 0;
+    logged[0] = logged[1] = false;
+
+    const size_t bins = static_cast<size_t>(active.size) / 2 + 1;
+    std::lock_guard<std::mutex> lock(mutex);
+    view.sample_rate = 0.0;
+    view.hop = hop;
+    view.bins = bins;
+    view.rows = 0;
+    view.frequencies.assign(bins, 0.0f);
+    for (int c = 0; c < 2; c++) {
+        view.magnitude[c].assign(bins, 0.0f);
+        view.spectrogram[c].assign(bins * static_cast<size_t>(active.history), 0.0f);
+        view.has_peak[c] = false;
+    }
+    view.transforms++;
+}
+
+void SpectrumAnalyzer::push(const Input& sample) {
+    if (history_count > 0 && (sample.t < last_t || sample.t - last_t > MAX_GAP)) {
+        restart();
+    }
+    last_t = sample.t;
+    const size_t n = history_t.size();
+    history_t[history_next] = sample.t;
+    history_v[history_next] = sample.v;
+    history_h[history_next] = sample.h;
+    history_next = (history_next + 1) & (n - 1);
+    history_count = std::min(history_count + 1, n);
+    since_transform++;
+
+    if (history_count == n && since_transform >= hop) {
+        since_transform = 0;
+        analyze();
+    }
+}
+
+void SpectrumAnalyzer::analyze() {
+    const auto start = std::chrono::steady_clock::now();
+    const size_t n = history_t.size();
+    const size_t bins = n / 2 + 1;
+
+    // Oldest sample first: the circular history is copied out in two contiguous runs
+    const size_t first = history_next; // the history is full, so the next slot holds the oldest sample
+    std::copy(history_v.begin() + first, history_v.end(), re.begin());
+    std::copy(history_v.begin(), history_v.begin() + first, re.begin() + (n - first));
+    std::copy(history_h.begin() + first, history_h.end(), im.begin());
+    std::copy(history_h.begin(), history_h.begin() + first, im.begin() + (n - first));
+    const double t = history_t[(first + n - 1) & (n - 1)];
+    const double sample_rate = (n - 1) / std::max(t - history_t[first], 1e-9);
+
+    double sum_v = 0.0, sum_h = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum_v += re[i];
+        sum_h += im[i];
+    }
+    const float mean_v = static_cast<float>(sum_v / n);
+    const float mean_h = static_cast<float>(sum_h / n);
+    for (size_t i = 0; i < n; i++) {
+        re[i] = (re[i] - mean_v) * window[i];
+        im[i] = (im[i] - mean_h) * window[i];
+    }
+
+    fft.transform(re.data(), im.data());
+
+    // Separates the two real channels: V[k] = (Z[k] + conj(Z[n-k])) / 2, H[k] = (Z[k] - conj(Z[n-k])) / 2i.
+    //   Amplitudes are single-sided (interior bins doubled) and divided by the window's gain.
+    const float interior = static_cast<float>(1.0 / (window_gain * window_gain));
+    const size_t half = n / 2;
+    for (size_t k : {size_t(0), half}) { // 0 Hz and Nyquist are their own mirror images
+        magnitude[0][k] = re[k] * re[k] * interior;
+        magnitude[1][k] = im[k] * im[k] * interior;
+    }
+    float* __restrict power_v = magnitude[0].data();
+    float* __restrict power_h = magnitude[1].data();
+    for (size_t k = 1; k < half; k++) {
+        const float vr = re[k] + re[n - k], vi = im[k] - im[n - k];
+        const float hr = im[k] + im[n - k], hi = re[k] - re[n - k];
+        power_v[k] = (vr * vr + vi * vi) * interior;
+        power_h[k] = (hr * hr + hi * hi) * interior;
+    }
+    for (std::vector<float>& m : magnitude) {
+        for (size_t k = 0; k < bins; k++) {
+            m[k] = 10.0f * std::log10(std::max(m[k], POWER_FLOOR));
+        }
+    }
+
+    SpectralPeak peaks[2];
+    bool found[2];
+    for (int c = 0; c < 2; c++) {
+        found[c] = find_peak(c, sample_rate, peaks[c]);
+        peaks[c].t = t;
+    }
+    transform_time.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count()));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    view.transforms++;
+    view.sample_rate = sample_rate;
+    view.t = t;
+    for (size_t k = 0; k < bins; k++) {
+        view.frequencies[k] = static_cast<float>(k * sample_rate / n);
+    }
+    const size_t rows = static_cast<size_t>(active.history);
+    view.rows = std::min(view.rows + 1, rows);
+    for (int c = 0; c < 2; c++) {
+        view.magnitude[c] = magnitude[c];
+        // Scrolls the spectrogram down one row and puts the new spectrum on top
+        std::vector<float>& spectrogram = view.spectrogram[c];
+        std::copy_backward(spectrogram.begin(), spectrogram.end() - bins, spectrogram.end());
+        std::copy(magnitude[c].begin(), magnitude[c].end(), spectrogram.begin());
+        view.has_peak[c] = found[c];
+        view.peak[c] = peaks[c];
+        log_peak(c, found[c], peaks[c]);
+    }
+}
+
+// The strongest local maximum at least peak_threshold dB above the median of the spectrum. DC and the first bin
+//   are skipped (mean removal and window leakage), as is the Nyquist bin.
+bool SpectrumAnalyzer::find_peak(int channel, double sample_rate, SpectralPeak& peak) {
+    const std::vector<float>& m = magnitude[channel];
+    const size_t bins = m.size();
+    floor_scratch.assign(m.begin() + 1, m.end());
+    auto middle = floor_scratch.begin() + floor_scratch.size() / 2;
+    std::nth_element(floor_scratch.begin(), middle, floor_scratch.end());
+    const float threshold = *middle + static_cast<float>(active.peak_threshold);
+
+    size_t best = 0;
+    for (size_t k = 2; k + 1 < bins; k++) {
+        if (m[k] > threshold && m[k] > m[k - 1] && m[k] >= m[k + 1] && (best == 0 || m[k] > m[best])) {
+            best = k;
+        }
+    }
+    if (best == 0) {
+        return false;
+    }
+    // Parabola through the peak bin and its neighbours (in dB)
+    const double a = m[best - 1], b = m[best], c = m[best + 1];
+    const double curvature = a - 2.0 * b + c;
+    const double offset = curvature < 0.0 ? 0.5 * (a - c) / curvature : 0.0;
+    peak.channel = channel;
+    peak.frequency = (best + offset) * sample_rate / (2 * (bins - 1));
+    peak.magnitude = b - 0.25 * (a - c) * offset;
+    return true;
+}
+
+// Logs a channel's dominant peak when it appears or moves by more than PEAK_MOVE_BINS (under the mutex)
+void SpectrumAnalyzer::log_peak(int channel, bool found, const SpectralPeak& peak) {
+    if (!found) {
+        logged[channel] = false;
+        return;
+    }
+    const double bin_width = view.sample_rate / active.size;
+    if (logged[channel] && std::abs(peak.frequency - logged_frequency[channel]) <= PEAK_MOVE_BINS * bin_width) {
+        return;
+    }
+    logged[channel] = true;
+    logged_frequency[channel] = peak.frequency;
+    peak_log.push_back(peak);
+    if (peak_log.size() > MAX_PEAK_LOG) {
+        peak_log.pop_front();
+    }
+    std::cout << "Spectrum: " << (channel == 0 ? "vertical" : "horizontal") << " dominant at " << std::fixed
+              << std::setprecision(2) << peak.frequency << " Hz (" << std::setprecision(1) << peak.magnitude << " dB) at t = "
+              << std::setprecision(2) << peak.t << " s" << std::defaultfloat << std::endl;
+}
@@ -0,0 +1,157 @@
+// Spectral Analysis
+//   Windowed, overlapping FFTs of both force channels, for vibration, flutter and vortex shedding that the time plots
+//   hide. The render loop hands every drained sample (live or replayed) to the analyzer, whose own worker thread does
+//   the transforms, so neither the render loop nor the I/O thread ever waits for one.
+//
+// Each time `hop` new samples have arrived (size * (1 - overlap)), the last `size` samples of each channel have their
+// mean removed, are windowed and transformed. Both channels are real, so they share one complex FFT (vertical as the
+// real part, horizontal as the imaginary part) and are separated afterwards. The result is a single-sided amplitude
+// spectrum in dB (20 log10 of the force amplitude), appended as a row to each channel's spectrogram.
+// A peak is a local maximum standing peak_threshold dB above the spectrum's median (the noise floor); the strongest
+// one per channel is the dominant frequency, refined between bins by parabolic interpolation. Dominant peaks are
+// logged (and printed) whenever they appear or move, and can be exported.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "histogram.h"
+#include "sample.h"
+#include "spsc_ring.h"
+
+enum class SpectrumWindow { Rectangular, Hann, Hamming, BlackmanHarris };
+
+const char* spectrum_window_name (SpectrumWindow window);
+
+struct SpectrumSettings {
+    int size = 256;                 // samples per transform (a power of two, see MIN/MAX_SPECTRUM_SIZE)
+    int overlap = 75;               // percent of each transform shared with the next one
+    SpectrumWindow window = SpectrumWindow::Hann;
+    double peak_threshold = 12.0;   // dB above the noise floor
+    int history = 200;              // spectrogram rows kept per channel
+};
+
+const int MIN_SPECTRUM_SIZE = 64;
+const int MAX_SPECTRUM_SIZE = 8192;
+
+struct SpectralPeak {
+    double t = 0.0;          // time of the newest sample in the transform
+    int channel = 0;         // 0 vertical, 1 horizontal
+    double frequency = 0.0;  // Hz
+    double magnitude = 0.0;  // dB
+};
+
+// In-place radix-2 FFT over split real and imaginary arrays. The twiddle factors of every stage are stored
+//   contiguously, so each butterfly loop walks plain float arrays the compiler can vectorize.
+class Fft {
+public:
+    explicit Fft(size_t n = 0);
+
+    void transform(float* re, float* im) const;
+    size_t size() const { return n; }
+
+private:
+    size_t n = 0;
+    std::vector<uint32_t> swaps;     // index pairs exchanged by the bit-reversal permutation
+    std::vector<float> twiddle_re;   // stage with half size m starts at offset m - 1 (m = 1, 2, 4, ...)
+    std::vector<float> twiddle_im;
+};
+
+// The latest results, copied out for the render loop
+struct SpectrumView {
+    uint64_t transforms = 0;                // transforms done so far (unchanged: nothing new)
+    double sample_rate = 0.0;
+    double t = 0.0;                         // newest sample of the latest transform
+    size_t hop = 0;                         // samples between spectrogram rows
+    size_t bins = 0;                        // size / 2 + 1, from 0 Hz to sample_rate / 2
+    size_t rows = 0;                        // spectrogram rows filled so far
+    std::vector<float> frequencies;         // Hz, per bin
+    std::vector<float> magnitude[2];        // dB per bin, latest transform of each channel
+    std::vector<float> spectrogram[2];      // rows x bins, dB, newest row first
+    bool has_peak[2] = {false, false};
+    SpectralPeak peak[2];                   // dominant peak of the latest transform
+};
+
+class SpectrumAnalyzer {
+public:
+    SpectrumAnalyzer();
+    ~SpectrumAnalyzer();
+
+    SpectrumAnalyzer(const SpectrumAnalyzer&) = delete;
+    SpectrumAnalyzer& operator=(const SpectrumAnalyzer&) = delete;
+
+    void start();
+    void stop();
+
+    // Thread-safe. Clears the buffered samples and the spectrogram.
+    void configure(const SpectrumSettings& settings);
+    SpectrumSettings get_settings() const;
+
+    // Single producer (the render loop). A gap or a step back in time (e.g. a replay seek, a reconnect) restarts the
+    //   analysis, so no transform ever spans one.
+    void add(const Sample* block, size_t count);
+
+    // Copies the latest results into view, unless view.transforms shows it is already up to date. Any thread.
+    void get_view(SpectrumView& view) const;
+    // Every logged dominant peak change, oldest first (bounded, see MAX_PEAK_LOG)
+    std::vector<SpectralPeak> get_peak_log() const;
+    bool export_peaks(const std::string& path) const;
+    void clear_peak_log();
+
+    // Time to analyze one transform (both channels)
+    const Histogram& get_transform_time() const { return transform_time; }
+    uint64_t get_dropped() const { return input.overflows(); }
+
+private:
+    struct Input {
+        double t;
+        float v;
+        float h;
+    };
+
+    void run();
+    void rebuild();
+    void restart();
+    void push(const Input& sample);
+    void analyze();
+    bool find_peak(int channel, double sample_rate, SpectralPeak& peak);
+    void log_peak(int channel, bool found, const SpectralPeak& peak);
+
+    SpscRing<Input> input;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool running = false;
+    SpectrumSettings settings;
+    bool reconfigure = true;
+
+    // Published results, under the mutex
+    SpectrumView view;
+    std::deque<SpectralPeak> peak_log;
+
+    // Worker thread only
+    SpectrumSettings active;
+    Fft fft;
+    std::vector<float> window;
+    double window_gain = 1.0;         // sum of the window, so amplitudes come out in force units
+    std::vector<double> history_t;    // the last `size` samples, circular
+    std::vector<float> history_v, history_h;
+    size_t history_next = 0;
+    size_t history_count = 0;
+    size_t hop = 1;                   // samples between transforms
+    size_t since_transform = 0;
+    double last_t = 0.0;
+    std::vector<float> re, im, magnitude[2], floor_scratch;
+    bool logged[2] = {false, false};  // whether each channel's current dominant peak was logged
+    double logged_frequency[2] = {0.0, 0.0};
+
+    Histogram transform_time{"spectrum transform", "us"};
+};
@@ -0,0 +1,83 @@
+// Lock-free single-producer/single-consumer ring buffer
+//   One thread (the serial engine) pushes, one thread (the render loop) pops. Neither side ever blocks or takes a lock:
+//   the producer only writes `tail`, the consumer only writes `head`, and each publishes with a release store.
+//   When the ring is full, push() fails and the sample is counted in overflows() instead of overwriting unread data.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template <typename T>
+class SpscRing {
+public:
+    // capacity is rounded up to the next power of two so indices can be masked instead of divided
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side
+    bool push(const T& item) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head > mask) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head > mask) {
+                overflow_count.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: pops up to max_count items into out, returns how many were popped
+    size_t pop(T* out, size_t max_count) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (cached_tail == h) {
+            cached_tail = tail.load(std::memory_order_acquire);
+        }
+        size_t count = cached_tail - h;
+        if (count > max_count) {
+            count = max_count;
+        }
+        for (size_t i = 0; i < count; i++) {
+            out[i] = slots[(h + i) & mask];
+        }
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    bool pop(T& out) {
+        return pop(&out, 1) == 1;
+    }
+
+    // Approximate when called concurrently with push/pop
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+    size_t capacity() const { return mask + 1; }
+    uint64_t overflows() const { return overflow_count.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    // head and tail live on separate cache lines (together with the side's cached copy of the other index)
+    //   so the producer and consumer don't invalidate each other's line on every operation
+    alignas(64) std::atomic<size_t> head{0};
+    size_t cached_tail = 0; // consumer's last view of tail
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t cached_head = 0; // producer's last view of head
+    alignas(64) std::atomic<uint64_t> overflow_count{0};
+};
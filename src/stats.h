@@ -0,0 +1,94 @@
+// Streaming Statistics
+//   Single-pass, O(1) per sample summaries. RunningStats never stores the samples; RollingWindow stores only its window.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// Running mean and variance (Welford's method, numerically stable even for large offsets)
+class RunningStats {
+public:
+    void add(double x) {
+        count++;
+        double delta = x - mean;
+        mean += delta / count;
+        m2 += delta * (x - mean);
+    }
+
+    void reset() {
+        count = 0;
+        mean = 0.0;
+        m2 = 0.0;
+    }
+
+    uint64_t get_count() const { return count; }
+    double get_mean() const { return mean; }
+    // Sample variance (n - 1), 0 until there are two samples
+    double get_variance() const { return count > 1 ? m2 / (count - 1) : 0.0; }
+    double get_stddev() const { return std::sqrt(get_variance()); }
+
+private:
+    uint64_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+};
+
+// Mean, min and max of the last `length` values. Min and max use monotonic queues, so each value is pushed and
+//   popped at most once (amortized O(1) per sample, independent of the window length).
+class RollingWindow {
+public:
+    explicit RollingWindow(size_t length = 1) : length(length > 0 ? length : 1) {}
+
+    void add(float x) {
+        values.push_back(x);
+        sum += x;
+        while (!mins.empty() && mins.back() > x) mins.pop_back();
+        mins.push_back(x);
+        while (!maxs.empty() && maxs.back() < x) maxs.pop_back();
+        maxs.push_back(x);
+
+        if (values.size() > length) {
+            float old = values.front();
+            values.pop_front();
+            sum -= old;
+            if (mins.front() == old) mins.pop_front();
+            if (maxs.front() == old) maxs.pop_front();
+        }
+        // Recomputes the sum once per window, so rounding errors of the running sum can't accumulate
+        if (++since_resum >= length) {
+            sum = 0.0;
+            for (float v : values) sum += v;
+            since_resum = 0;
+        }
+    }
+
+    void reset() {
+        values.clear();
+        mins.clear();
+        maxs.clear();
+        sum = 0.0;
+        since_resum = 0;
+    }
+
+    void set_length(size_t new_length) {
+        length = new_length > 0 ? new_length : 1;
+        reset();
+    }
+
+    size_t get_length() const { return length; }
+    size_t get_count() const { return values.size(); }
+    double get_mean() const { return values.empty() ? 0.0 : sum / values.size(); }
+    float get_min() const { return mins.empty() ? 0.0f : mins.front(); }
+    float get_max() const { return maxs.empty() ? 0.0f : maxs.front(); }
+
+private:
+    size_t length;
+    std::deque<float> values;
+    std::deque<float> mins; // non-decreasing
+    std::deque<float> maxs; // non-increasing
+    double sum = 0.0;
+    size_t since_resum = 0;
+};
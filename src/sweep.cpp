@@ -0,0 +1,150 @@
+#include "sweep.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "config.h"
+
+// An angle command that has not shown up in the samples after this long (e.g. a corrupted frame) is sent again
+const double ANGLE_RESEND = 1.0;
+
+const char* sweep_state_name (Sweep::State state) {
+    switch (state) {
+        case Sweep::State::Idle: return "idle";
+        case Sweep::State::Settling: return "settling";
+        case Sweep::State::Measuring: return "measuring";
+        case Sweep::State::Done: return "done";
+        default: return "unknown";
+    }
+}
+
+bool Sweep::start(const SweepSettings& new_settings, SerialEngine& new_engine) {
+    if (new_settings.step <= 0 || new_settings.samples <= 0 || new_settings.dwell <= 0.0 || new_settings.settle_window <= 0.0) {
+        std::cerr << "Error: sweep step, samples, dwell and settle window must be positive." << std::endl;
+        return false;
+    }
+    settings = new_settings;
+    engine = &new_engine;
+    points.clear();
+    std::cout << "Sweep: " << get_point_count() << " points from " << settings.start << " to " << settings.stop << std::endl;
+    move_to(settings.start);
+    return true;
+}
+
+void Sweep::stop() {
+    if (is_running()) {
+        std::cout << "Sweep stopped after " << points.size() << " points" << std::endl;
+    }
+    state = points.empty() ? State::Idle : State::Done;
+}
+
+size_t Sweep::get_point_count() const {
+    return static_cast<size_t>(std::abs(settings.stop - settings.start) / settings.step) + 1;
+}
+
+void Sweep::move_to(int16_t angle) {
+    target = angle;
+    arrived_at = -1.0;
+    window.clear();
+    lift.reset();
+    drag.reset();
+    engine->send_angle(static_cast<int16_t>(BASE_ANGLE + angle));
+    sent_at = host_time();
+    commanded_at = sent_at;
+    state = State::Settling;
+}
+
+void Sweep::update(const Sample& sample) {
+    if (!is_running()) {
+        return;
+    }
+    // Samples measured before the Arduino applied the new angle don't belong to this point
+    if (sample.angle != BASE_ANGLE + target) {
+        if (sample.t - sent_at > ANGLE_RESEND) {
+            engine->send_angle(static_cast<int16_t>(BASE_ANGLE + target));
+            sent_at = sample.t;
+        }
+        return;
+    }
+    if (arrived_at < 0.0) {
+        arrived_at = sample.t;
+    }
+
+    if (state == State::Settling) {
+        window.push_back(sample);
+        while (sample.t - window.front().t > settings.settle_window) {
+            window.pop_front();
+        }
+        // The settle time includes the servo's travel; the window only holds samples at the new angle
+        const double elapsed = sample.t - commanded_at;
+        const bool timed_out = elapsed >= settings.dwell;
+        if ((sample.t - arrived_at >= settings.settle_window && is_settled()) || timed_out) {
+            settled = !timed_out;
+            settle_time = elapsed;
+            state = State::Measuring;
+        }
+        return;
+    }
+
+    lift.add(sample.v);
+    drag.add(sample.h);
+    if (lift.get_count() >= static_cast<uint64_t>(settings.samples)) {
+        finish_point();
+    }
+}
+
+bool Sweep::is_settled() const {
+    // Compares the means of the older and newer half of the window
+    RunningStats older_v, older_h, newer_v, newer_h;
+    const double middle = window.back().t - settings.settle_window / 2.0;
+    for (const Sample& s : window) {
+        if (s.t < middle) {
+            older_v.add(s.v);
+            older_h.add(s.h);
+        } else {
+            newer_v.add(s.v);
+            newer_h.add(s.h);
+        }
+    }
+    if (older_v.get_count() < 2 || newer_v.get_count() < 2) {
+        return false;
+    }
+    auto agrees = [&](const RunningStats& a, const RunningStats& b) {
+        double standard_error = std::sqrt(a.get_variance() / a.get_count() + b.get_variance() / b.get_count());
+        return std::fabs(a.get_mean() - b.get_mean()) <= settings.settle_tolerance + 3.0 * standard_error;
+    };
+    return agrees(older_v, newer_v) && agrees(older_h, newer_h);
+}
+
+void Sweep::finish_point() {
+    points.push_back({target, lift.get_mean(), lift.get_stddev(), drag.get_mean(), drag.get_stddev(),
+                      lift.get_count(), settle_time, settled});
+    std::cout << "Sweep: angle " << target << ", lift " << lift.get_mean() << " +/- " << lift.get_stddev()
+              << ", drag " << drag.get_mean() << " +/- " << drag.get_stddev()
+              << (settled ? "" : " (not settled)") << std::endl;
+
+    if (points.size() >= get_point_count()) {
+        std::cout << "Sweep done" << std::endl;
+        state = State::Done;
+        return;
+    }
+    const int16_t direction = settings.stop >= settings.start ? 1 : -1;
+    move_to(static_cast<int16_t>(target + direction * settings.step));
+}
+
+bool Sweep::export_csv(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: could not open " << path << " for writing." << std::endl;
+        return false;
+    }
+    file << "angle,lift_mean,lift_stddev,drag_mean,drag_stddev,samples,settle_time_s,settled\n";
+    for (const PolarPoint& p : points) {
+        file << p.angle << ',' << p.lift_mean << ',' << p.lift_stddev << ',' << p.drag_mean << ',' << p.drag_stddev << ','
+             << p.samples << ',' << p.settle_time << ',' << (p.settled ? 1 : 0) << '\n';
+    }
+    std::cout << "Polar saved to " << path << std::endl;
+    return true;
+}
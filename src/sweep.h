@@ -0,0 +1,81 @@
+// Angle of Attack Sweep
+//   Steps the servo from start to stop, and at every angle waits for the forces to settle, averages a fixed number of
+//   samples and adds a point to the polar (angle vs. lift/drag). Fed with every sample from the consumer thread.
+//
+// A point is settled once the means of the two halves of the last settle_window seconds agree (for both channels)
+//   within settle_tolerance plus three standard errors, so noise alone never holds a point back but a force that is
+//   still moving does. If that never happens within dwell seconds of the angle command, the point is measured anyway and marked unsettled.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "sample.h"
+#include "serial_engine.h"
+#include "stats.h"
+
+struct SweepSettings {
+    int16_t start = -10;          // angles relative to BASE_ANGLE, like the dashboard slider
+    int16_t stop = 10;
+    int16_t step = 1;
+    double dwell = 10.0;          // longest time to wait for a point to settle (seconds)
+    int samples = 80;             // samples averaged per point
+    double settle_window = 0.5;   // seconds
+    float settle_tolerance = 0.05f;
+};
+
+struct PolarPoint {
+    int16_t angle;     // relative to BASE_ANGLE
+    double lift_mean;  // vertical
+    double lift_stddev;
+    double drag_mean;  // horizontal
+    double drag_stddev;
+    uint64_t samples;
+    double settle_time; // seconds from the angle command until the point settled
+    bool settled;
+};
+
+class Sweep {
+public:
+    enum class State { Idle, Settling, Measuring, Done };
+
+    // Commands the first angle through engine. Returns false if the settings describe no points.
+    bool start(const SweepSettings& settings, SerialEngine& engine);
+    void stop();
+
+    // Advances the sweep with the next sample (in time order)
+    void update(const Sample& sample);
+
+    State get_state() const { return state; }
+    bool is_running() const { return state == State::Settling || state == State::Measuring; }
+    const SweepSettings& get_settings() const { return settings; }
+    const std::vector<PolarPoint>& get_points() const { return points; }
+    size_t get_point_count() const; // points in the whole sweep
+    int16_t get_target() const { return target; } // relative angle currently being measured
+
+    bool export_csv(const std::string& path) const;
+
+private:
+    bool is_settled() const;
+    void move_to(int16_t angle);
+    void finish_point();
+
+    SweepSettings settings;
+    SerialEngine* engine = nullptr;
+    State state = State::Idle;
+    std::vector<PolarPoint> points;
+
+    int16_t target = 0;
+    double sent_at = 0.0;       // host time of the last angle command (resends included)
+    double commanded_at = 0.0;  // host time the point's angle was first commanded
+    double arrived_at = -1.0;   // time of the first sample at the new angle (-1 until it arrives)
+    double settle_time = 0.0;
+    bool settled = false;
+    std::deque<Sample> window;
+    RunningStats lift, drag;
+};
+
+const char* sweep_state_name (Sweep::State state);
@@ -0,0 +1,100 @@
+#include "work_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    TaskQueue& queue = *queues[next_queue++ % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        queued++;
+        unfinished++;
+    }
+    work_cv.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(state_mutex);
+    done_cv.wait(lock, [this] { return unfinished == 0; });
+}
+
+// Takes the newest task of the worker's own deque, or else steals the oldest task of another worker
+bool WorkStealingPool::take(unsigned index, std::function<void()>& task) {
+    {
+        TaskQueue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); i++) {
+        TaskQueue& victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(unsigned index) {
+    std::function<void()> task;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            work_cv.wait(lock, [this] { return stopping || queued > 0; });
+            if (queued == 0) {
+                return; // stopping, and nothing left to do
+            }
+            queued--; // reserves one task, which take() is then guaranteed to find in some deque
+        }
+        while (!take(index, task)) {
+            std::this_thread::yield(); // only until the submitter's push becomes visible
+        }
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+        task = nullptr;
+
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (--unfinished == 0) {
+            done_cv.notify_all();
+        }
+    }
+}
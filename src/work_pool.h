@@ -0,0 +1,58 @@
+// Work-Stealing Thread Pool
+//   A fixed set of workers, each with its own task deque. A worker takes its own tasks from the back and, once it runs
+//   out, steals from the front of the other workers' deques. Tasks of very different sizes (e.g. runs of a few seconds
+//   next to runs of an hour) therefore keep every core busy until the last one is done, without a central queue that
+//   every worker contends on.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    // 0 threads uses one per hardware thread
+    explicit WorkStealingPool(unsigned threads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Tasks are spread round robin over the workers' deques
+    void submit(std::function<void()> task);
+    // Blocks until every submitted task has finished
+    void wait();
+
+    unsigned get_thread_count() const { return static_cast<unsigned>(workers.size()); }
+    uint64_t get_steal_count() const { return steals; }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take(unsigned index, std::function<void()>& task);
+    void run(unsigned index);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex state_mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    size_t queued = 0;      // tasks in the deques (guarded by state_mutex)
+    size_t unfinished = 0;  // tasks submitted but not finished (guarded by state_mutex)
+    bool stopping = false;
+
+    std::atomic<unsigned> next_queue{0};
+    std::atomic<uint64_t> steals{0};
+};
@@ -0,0 +1,320 @@
+// Offline Batch Analysis
+//   Summarizes a whole campaign of recorded runs (.wtr, see src/recording.h) in one table, processing the runs in
+//   parallel on a work-stealing pool (src/work_pool.h), one task per run.
+//
+// Usage: batch <directory|file.wtr>... [--output <summary.csv>] [--threads <n>] [--config <path>] [--settle <seconds>]
+//              [--q <Pa>] [--area <m^2>] [--force-scale <N per unit>]
+//   For every run and every angle it reports the mean and standard deviation of lift (vertical) and drag (horizontal),
+//   the number of outliers, the lift/drag coefficients and the drift of both channels over the run.
+//   --config recalibrates the runs' raw counts with the calibration in that file (by default each run keeps the
+//   calibration it was recorded with). --settle skips the samples right after each angle change (0.5 s by default).
+//   The coefficients need the dynamic pressure (--q) and the reference area (--area); --force-scale converts the
+//   calibrated readings to newtons (grams by default).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "recording.h"
+#include "stats.h"
+#include "work_pool.h"
+
+// A sample further than OUTLIER_MADS scaled median absolute deviations from its angle's median is an outlier
+const double OUTLIER_MADS = 5.0;
+const double MAD_TO_STDDEV = 1.4826; // for normally distributed noise
+const double GRAMS_TO_NEWTONS = 9.80665e-3;
+
+struct Options {
+    std::vector<std::string> inputs;
+    std::string output = "summary.csv";
+    unsigned threads = 0;
+    std::string config;
+    double settle = 0.5;
+    double q = 0.0;
+    double area = 0.0;
+    double force_scale = GRAMS_TO_NEWTONS;
+};
+
+struct AngleSummary {
+    int16_t angle;             // relative to the run's base angle
+    uint64_t outliers = 0;
+    RunningStats lift;         // inliers only
+    RunningStats drag;
+};
+
+struct RunSummary {
+    std::string path;
+    bool ok = false;
+    uint64_t samples = 0;
+    double duration = 0.0;
+    Calibration calibration;
+    double drift_lift = 0.0;   // units per minute, after removing each angle's mean
+    double drift_drag = 0.0;
+    std::vector<AngleSummary> angles;
+};
+
+// One angle's settled samples, before outlier rejection
+struct AngleSamples {
+    std::vector<double> t;
+    std::vector<float> lift;
+    std::vector<float> drag;
+};
+
+// Least squares slope of y against t, accumulated one point at a time
+struct SlopeFit {
+    void add(double t, double y) {
+        n++;
+        st += t;
+        sy += y;
+        stt += t * t;
+        sty += t * y;
+    }
+
+    double get_slope() const {
+        double denominator = n * stt - st * st;
+        return (n > 1 && denominator > 0.0) ? (n * sty - st * sy) / denominator : 0.0;
+    }
+
+    double n = 0.0, st = 0.0, sy = 0.0, stt = 0.0, sty = 0.0;
+};
+
+void print_usage () {
+    std::cerr << "Usage: batch <directory|file.wtr>... [--output <summary.csv>] [--threads <n>] [--config <path>] [--settle <seconds>]" << std::endl
+              << "             [--q <Pa>] [--area <m^2>] [--force-scale <N per unit>]" << std::endl;
+}
+
+bool parse_options (int argc, char** argv, Options& options) {
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h") {
+                return false;
+            }
+            if (flag.compare(0, 2, "--") != 0) {
+                options.inputs.push_back(flag);
+                continue;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << flag << " needs a value." << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+            if (flag == "--output") options.output = value;
+            else if (flag == "--threads") options.threads = static_cast<unsigned>(std::stoul(value));
+            else if (flag == "--config") options.config = value;
+            else if (flag == "--settle") options.settle = std::stod(value);
+            else if (flag == "--q") options.q = std::stod(value);
+            else if (flag == "--area") options.area = std::stod(value);
+            else if (flag == "--force-scale") options.force_scale = std::stod(value);
+            else {
+                std::cerr << "Error: unknown flag " << flag << std::endl;
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: invalid argument (" << e.what() << ")" << std::endl;
+        return false;
+    }
+    return !options.inputs.empty();
+}
+
+// Every .wtr file named on the command line or directly inside a named directory, sorted by path
+std::vector<std::string> find_runs (const std::vector<std::string>& inputs) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> runs;
+    for (const std::string& input : inputs) {
+        std::error_code error;
+        if (fs::is_directory(input, error)) {
+            for (const fs::directory_entry& entry : fs::directory_iterator(input, error)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".wtr") {
+                    runs.push_back(entry.path().string());
+                }
+            }
+        } else if (fs::exists(input, error)) {
+            runs.push_back(input);
+        } else {
+            std::cerr << "Error: " << input << " does not exist." << std::endl;
+        }
+    }
+    std::sort(runs.begin(), runs.end());
+    return runs;
+}
+
+double median (std::vector<double>& values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    auto middle = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), middle, values.end());
+    return *middle;
+}
+
+// Median and scaled median absolute deviation, robust against the outliers they are used to find
+void robust_spread (const std::vector<float>& values, double& center, double& spread) {
+    std::vector<double> scratch(values.begin(), values.end());
+    center = median(scratch);
+    for (double& value : scratch) {
+        value = std::abs(value - center);
+    }
+    spread = MAD_TO_STDDEV * median(scratch);
+}
+
+// Runs on a pool worker. Only writes to its own summary, so runs need no locking. recalibration, if given, replaces
+//   the calibration the run was recorded with.
+void analyze_run (const std::string& path, const Options& options, const Calibration* recalibration, RunSummary& summary) {
+    summary.path = path;
+    RecordingReader reader;
+    if (!reader.open(path)) {
+        return;
+    }
+    const RecordingHeader& header = reader.get_header();
+    const SampleRecord* records = reader.get_records();
+    summary.samples = reader.size();
+    summary.duration = reader.duration();
+
+    summary.calibration = recalibration ? *recalibration : reader.get_calibration();
+
+    // Groups the settled samples by commanded angle
+    std::map<int16_t, AngleSamples> groups;
+    double angle_since = 0.0;
+    for (uint64_t i = 0; i < reader.size(); i++) {
+        const SampleRecord& record = records[i];
+        if (i == 0 || record.angle != records[i - 1].angle) {
+            angle_since = record.t;
+        }
+        if (record.t - angle_since < options.settle) {
+            continue;
+        }
+        float raw_v, raw_h, lift, drag;
+        reader.get_raw(record, raw_v, raw_h);
+        summary.calibration.apply(raw_v, raw_h, lift, drag);
+        AngleSamples& group = groups[record.angle];
+        group.t.push_back(record.t);
+        group.lift.push_back(lift);
+        group.drag.push_back(drag);
+    }
+
+    // Rejects outliers per angle, and fits the drift to what is left once each angle's level is removed
+    SlopeFit drift_lift, drift_drag;
+    for (const auto& [angle, group] : groups) {
+        AngleSummary result;
+        result.angle = static_cast<int16_t>(angle - header.base_angle);
+        double center_v, spread_v, center_h, spread_h;
+        robust_spread(group.lift, center_v, spread_v);
+        robust_spread(group.drag, center_h, spread_h);
+        for (size_t i = 0; i < group.t.size(); i++) {
+            const bool outlier = (spread_v > 0.0 && std::abs(group.lift[i] - center_v) > OUTLIER_MADS * spread_v)
+                              || (spread_h > 0.0 && std::abs(group.drag[i] - center_h) > OUTLIER_MADS * spread_h);
+            if (outlier) {
+                result.outliers++;
+                continue;
+            }
+            result.lift.add(group.lift[i]);
+            result.drag.add(group.drag[i]);
+            drift_lift.add(group.t[i] / 60.0, group.lift[i] - center_v);
+            drift_drag.add(group.t[i] / 60.0, group.drag[i] - center_h);
+        }
+        summary.angles.push_back(result);
+    }
+    summary.drift_lift = drift_lift.get_slope();
+    summary.drift_drag = drift_drag.get_slope();
+    summary.ok = true;
+}
+
+bool write_summary (const std::string& path, const std::vector<RunSummary>& runs, const Options& options) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: could not open " << path << " for writing." << std::endl;
+        return false;
+    }
+    // Coefficients are left empty unless the dynamic pressure and area are known
+    const double coefficient_scale = (options.q > 0.0 && options.area > 0.0) ? options.force_scale / (options.q * options.area) : 0.0;
+
+    file << "run,angle,samples,outliers,lift_mean,lift_stddev,drag_mean,drag_stddev,cl,cd,"
+            "drift_lift_per_min,drift_drag_per_min,calibration_v,calibration_h,offset_v,offset_h,crosstalk_vh,crosstalk_hv\n";
+    file << std::setprecision(8);
+    for (const RunSummary& run : runs) {
+        if (!run.ok) {
+            continue;
+        }
+        const std::string name = std::filesystem::path(run.path).filename().string();
+        for (const AngleSummary& angle : run.angles) {
+            file << name << ',' << angle.angle << ',' << angle.lift.get_count() << ',' << angle.outliers << ','
+                 << angle.lift.get_mean() << ',' << angle.lift.get_stddev() << ','
+                 << angle.drag.get_mean() << ',' << angle.drag.get_stddev() << ',';
+            if (coefficient_scale > 0.0) {
+                file << angle.lift.get_mean() * coefficient_scale << ',' << angle.drag.get_mean() * coefficient_scale;
+            } else {
+                file << ',';
+            }
+            const Calibration& c = run.calibration;
+            file << ',' << run.drift_lift << ',' << run.drift_drag << ',' << c.factor_v << ',' << c.factor_h << ','
+                 << c.offset_v << ',' << c.offset_h << ',' << c.crosstalk_vh << ',' << c.crosstalk_hv << '\n';
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    Calibration recalibration;
+    if (!options.config.empty() && !load_config(recalibration, options.config)) {
+        return 1;
+    }
+    const Calibration* override = options.config.empty() ? nullptr : &recalibration;
+
+    std::vector<std::string> paths = find_runs(options.inputs);
+    if (paths.empty()) {
+        std::cerr << "Error: no recordings found." << std::endl;
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<RunSummary> runs(paths.size());
+    WorkStealingPool pool(options.threads);
+    for (size_t i = 0; i < paths.size(); i++) {
+        pool.submit([&, i]() { analyze_run(paths[i], options, override, runs[i]); });
+    }
+    pool.wait();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t total_samples = 0;
+    size_t failed = 0;
+    for (const RunSummary& run : runs) {
+        if (!run.ok) {
+            failed++;
+            continue;
+        }
+        uint64_t outliers = 0;
+        for (const AngleSummary& angle : run.angles) {
+            outliers += angle.outliers;
+        }
+        total_samples += run.samples;
+        std::cout << run.path << ": " << run.samples << " samples over " << std::fixed << std::setprecision(1) << run.duration
+                  << " s, " << run.angles.size() << " angles, " << outliers << " outliers, drift " << std::setprecision(4)
+                  << run.drift_lift << " / " << run.drift_drag << " per min" << std::defaultfloat << std::endl;
+    }
+    std::cout << "Analyzed " << (runs.size() - failed) << " runs (" << total_samples << " samples) in " << elapsed << " s on "
+              << pool.get_thread_count() << " threads" << std::endl;
+
+    if (!write_summary(options.output, runs, options)) {
+        return 1;
+    }
+    std::cout << "Summary saved to " << options.output << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,410 @@
+// Serial Link Benchmark
+//   Measures what the serial link sustains, to choose --max-baud and the stream rate, and to compare ports, cables
+//   and USB bridges.
+//
+// Usage: bench [--port <port|auto>] [--baud <baud>] [--max-baud <baud>] [--duration <seconds>] [--requests <n>]
+//              [--output <file.csv>]
+//        bench --loopback <port|pty> [--baud <baud>] [--duration <seconds>] [--size <bytes>] [--output <file.csv>]
+//   Against the wind tunnel (the Arduino, or tools/simulator.cpp), through SerialEngine like the dashboard, at the link
+//   rate it negotiates up to --max-baud:
+//   - streaming: every conversion is streamed (rate 0) for --duration seconds, for samples/s, bytes/s, and the lost
+//     and corrupted frames;
+//   - polling: --requests single WT_MSG_READ round trips, then --requests angle commands (one degree either side of
+//     BASE_ANGLE), each waiting for its acknowledgement, for the read and command round trip percentiles.
+//   --loopback measures the bare port, without the protocol or an Arduino: a port with TX wired to RX (or a loopback
+//   plug), or "pty" for a pseudo-terminal echoed by a thread of the benchmark. Blocks of --size bytes are kept in
+//   flight for --duration seconds, for the echoed bytes/s, the mismatched bytes and the per-block round trip.
+//   --output appends one CSV row per run (with a header if the file is new), so setups can be compared over time.
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "histogram.h"
+#include "serial/serial.h"
+#include "serial_engine.h"
+
+const auto CONNECT_TIMEOUT = std::chrono::seconds(15);
+const auto WARMUP = std::chrono::milliseconds(500); // streaming settles before it is measured
+const auto SETTLE = std::chrono::milliseconds(300); // the stream drains after it stops
+const auto REPLY_TIMEOUT = std::chrono::seconds(1);
+const auto WAIT_STEP = std::chrono::milliseconds(1);
+// Loopback blocks in flight at once, so the port never runs dry waiting for a round trip
+const size_t LOOPBACK_WINDOW = 8;
+
+struct Options {
+    std::string port = DEFAULT_PORT;
+    unsigned long baud = BAUD;
+    unsigned long max_baud = MAX_BAUD;
+    double duration = 10.0;
+    int requests = 500;
+    std::string loopback;
+    size_t size = 64;
+    std::string output;
+};
+
+// One benchmark run, as printed and as written to --output
+struct Result {
+    std::string mode;            // "device" or "loopback"
+    std::string port;
+    unsigned long baud = 0;      // link rate the run was measured at
+    double seconds = 0.0;
+    double samples_per_second = 0.0;
+    double bytes_received_per_second = 0.0;
+    double bytes_sent_per_second = 0.0;
+    uint64_t lost = 0;           // device: frames lost; loopback: bytes never echoed back
+    uint64_t corrupted = 0;      // device: frames corrupted; loopback: bytes echoed back wrong
+    const Histogram* read_rtt = nullptr;    // device: WT_MSG_READ round trip; loopback: block round trip (us)
+    const Histogram* command_rtt = nullptr; // device only
+};
+
+static volatile std::sig_atomic_t stop_requested = 0;
+static std::atomic<uint64_t> samples_received{0}; // counted on the engine's I/O thread
+
+void handle_signal (int) {
+    stop_requested = 1;
+}
+
+void print_usage () {
+    std::cerr << "Usage: bench [--port <port|auto>] [--baud <baud>] [--max-baud <baud>] [--duration <seconds>] [--requests <n>]" << std::endl
+              << "             [--output <file.csv>]" << std::endl
+              << "       bench --loopback <port|pty> [--baud <baud>] [--duration <seconds>] [--size <bytes>] [--output <file.csv>]" << std::endl;
+}
+
+bool parse_options (int argc, char** argv, Options& options) {
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h") {
+                return false;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << flag << " needs a value." << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+            if (flag == "--port") options.port = value;
+            else if (flag == "--baud") options.baud = std::stoul(value);
+            else if (flag == "--max-baud") options.max_baud = std::stoul(value);
+            else if (flag == "--duration") options.duration = std::stod(value);
+            else if (flag == "--requests") options.requests = std::stoi(value);
+            else if (flag == "--loopback") options.loopback = value;
+            else if (flag == "--size") options.size = std::stoul(value);
+            else if (flag == "--output") options.output = value;
+            else {
+                std::cerr << "Error: unknown flag " << flag << std::endl;
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: invalid argument (" << e.what() << ")" << std::endl;
+        return false;
+    }
+    return options.duration > 0.0 && options.requests >= 0 && options.size > 0;
+}
+
+// Waits until done() or timeout, polling every WAIT_STEP. Returns done().
+template <typename Done>
+bool wait_for (Done done, std::chrono::steady_clock::duration timeout) {
+    const auto start = std::chrono::steady_clock::now();
+    while (!done() && !stop_requested && std::chrono::steady_clock::now() - start < timeout) {
+        std::this_thread::sleep_for(WAIT_STEP);
+    }
+    return done();
+}
+
+double seconds_since (std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Streams, then polls, the wind tunnel through a SerialEngine
+bool bench_device (const Options& options, SerialEngine& engine, Result& result) {
+    engine.set_frame_handler([](const WtFrame& frame) {
+        if (frame.type == WT_MSG_SAMPLE) {
+            samples_received++;
+        }
+    });
+    engine.set_max_baud(options.max_baud);
+    engine.set_command_rate(0); // every command goes out at once, so its round trip is the link's
+
+    try {
+        if (options.port == "auto") {
+            engine.connect("", options.baud);
+        } else if (!engine.open(options.port, options.baud)) {
+            std::cerr << "Error: serial port " << options.port << " did not open." << std::endl;
+            return false;
+        }
+    } catch (const serial::IOException& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return false;
+    }
+    if (!wait_for([&]() { return engine.is_connected() && engine.get_baud() != 0; }, CONNECT_TIMEOUT)) {
+        std::cerr << "Error: the wind tunnel did not answer." << std::endl;
+        return false;
+    }
+    result.mode = "device";
+    result.port = engine.get_port();
+    result.baud = engine.get_baud();
+    std::cout << "Connected on " << result.port << " at " << result.baud << " baud" << std::endl;
+
+    // Streaming: every conversion, as fast as the link carries them
+    std::cout << "Streaming for " << options.duration << " s..." << std::endl;
+    engine.start_stream(0);
+    std::this_thread::sleep_for(WARMUP);
+    const uint64_t samples_start = samples_received, received_start = engine.get_bytes_received(), sent_start = engine.get_bytes_sent();
+    const uint64_t lost_start = engine.get_frames_lost(), corrupted_start = engine.get_frames_corrupted();
+    const auto start = std::chrono::steady_clock::now();
+    wait_for([]() { return false; }, std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.duration)));
+    result.seconds = seconds_since(start);
+    result.samples_per_second = (samples_received - samples_start) / result.seconds;
+    result.bytes_received_per_second = (engine.get_bytes_received() - received_start) / result.seconds;
+    result.bytes_sent_per_second = (engine.get_bytes_sent() - sent_start) / result.seconds;
+    result.lost = engine.get_frames_lost() - lost_start;
+    result.corrupted = engine.get_frames_corrupted() - corrupted_start;
+    engine.stop_stream();
+    std::this_thread::sleep_for(SETTLE);
+
+    // Polling: the I/O thread sends the next WT_MSG_READ as soon as the previous sample arrived
+    std::cout << "Polling " << options.requests << " samples..." << std::endl;
+    const uint64_t reads = engine.get_read_rtt().count() + options.requests;
+    engine.set_polling(true);
+    wait_for([&]() { return engine.get_read_rtt().count() >= reads; }, REPLY_TIMEOUT * options.requests);
+    engine.set_polling(false);
+    std::this_thread::sleep_for(SETTLE);
+
+    // Commands: one at a time, each acknowledged before the next
+    std::cout << "Sending " << options.requests << " commands..." << std::endl;
+    for (int i = 0; i < options.requests && !stop_requested; i++) {
+        engine.send_angle(static_cast<int16_t>(BASE_ANGLE + (i % 2 == 0 ? 1 : -1)));
+        if (!wait_for([&]() { return engine.get_commands_unacked() == 0; }, REPLY_TIMEOUT)) {
+            std::cerr << "Error: command " << i << " was not acknowledged." << std::endl;
+        }
+    }
+    engine.send_angle(BASE_ANGLE);
+    wait_for([&]() { return engine.get_commands_unacked() == 0; }, REPLY_TIMEOUT);
+
+    if (engine.get_baud() != result.baud) {
+        std::cerr << "Error: the link fell back to " << engine.get_baud() << " baud during the run." << std::endl;
+    }
+    result.read_rtt = &engine.get_read_rtt();
+    result.command_rtt = &engine.get_command_rtt();
+    return true;
+}
+
+#ifndef _WIN32
+// Echoes everything written to the pty back to it, until stop
+void echo_pty (int master, const std::atomic<bool>& stop) {
+    uint8_t chunk[4096];
+    while (!stop) {
+        pollfd descriptor{master, POLLIN, 0};
+        if (poll(&descriptor, 1, 10) <= 0 || !(descriptor.revents & POLLIN)) {
+            continue;
+        }
+        ssize_t count = read(master, chunk, sizeof(chunk));
+        for (ssize_t written = 0; count > 0 && written < count && !stop;) {
+            ssize_t step = write(master, chunk + written, count - written);
+            if (step > 0) {
+                written += step;
+            }
+        }
+    }
+}
+#endif
+
+// Byte i of the loopback stream, so every echoed byte can be checked where it lands
+static inline uint8_t pattern (uint64_t i) {
+    return static_cast<uint8_t>((i * 131) ^ (i >> 8));
+}
+
+// Keeps LOOPBACK_WINDOW blocks in flight through a port whose output comes back as its input
+bool bench_loopback (const Options& options, Histogram& block_rtt, Result& result) {
+    std::string name = options.loopback;
+    std::atomic<bool> stop_echo{false};
+    std::thread echo;
+#ifndef _WIN32
+    int master = -1;
+    if (name == "pty") {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+            std::cerr << "Error: could not create a pseudo-terminal: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        name = ptsname(master);
+        echo = std::thread(echo_pty, master, std::cref(stop_echo));
+    }
+#endif
+
+    bool ok = true;
+    try {
+        serial::Serial port(name, options.baud, serial::Timeout(serial::Timeout::max(), 10, 0, 250, 0));
+        port.flushInput();
+        result.mode = "loopback";
+        result.port = options.loopback;
+        result.baud = port.getBaudrate();
+        std::cout << "Looping " << options.size << " byte blocks through " << name << " at " << result.baud << " baud for "
+                  << options.duration << " s..." << std::endl;
+
+        std::vector<uint8_t> block(options.size), chunk(4096);
+        std::deque<std::chrono::steady_clock::time_point> in_flight; // send time of each block not fully echoed yet
+        uint64_t sent = 0, received = 0;
+        const auto start = std::chrono::steady_clock::now();
+        const auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.duration));
+        auto last_byte = start;
+        while (!stop_requested) {
+            const auto now = std::chrono::steady_clock::now();
+            if (now >= end && (in_flight.empty() || now - last_byte > REPLY_TIMEOUT)) {
+                break; // done, and the echo has caught up (or stopped)
+            }
+            while (now < end && in_flight.size() < LOOPBACK_WINDOW) {
+                for (size_t i = 0; i < block.size(); i++) {
+                    block[i] = pattern(sent + i);
+                }
+                in_flight.push_back(std::chrono::steady_clock::now());
+                sent += port.write(block);
+            }
+            if (!port.waitReadable()) {
+                continue;
+            }
+            size_t count = port.read(chunk.data(), std::min(port.available(), chunk.size()));
+            last_byte = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < count; i++) {
+                if (chunk[i] != pattern(received + i)) {
+                    result.corrupted++;
+                }
+            }
+            received += count;
+            // Every block whose last byte is back has made its round trip
+            while (!in_flight.empty() && received >= (sent / options.size - in_flight.size() + 1) * options.size) {
+                block_rtt.record(std::chrono::duration_cast<std::chrono::microseconds>(last_byte - in_flight.front()).count());
+                in_flight.pop_front();
+            }
+        }
+        result.seconds = seconds_since(start);
+        result.bytes_sent_per_second = sent / result.seconds;
+        result.bytes_received_per_second = received / result.seconds;
+        result.lost = sent > received ? sent - received : 0;
+        result.read_rtt = &block_rtt;
+        if (received == 0) {
+            std::cerr << "Error: nothing came back. Is TX connected to RX?" << std::endl;
+            ok = false;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        ok = false;
+    }
+
+    stop_echo = true;
+    if (echo.joinable()) {
+        echo.join();
+    }
+#ifndef _WIN32
+    if (master >= 0) {
+        close(master);
+    }
+#endif
+    return ok;
+}
+
+void print_percentiles (const char* label, const Histogram* histogram) {
+    if (!histogram || histogram->count() == 0) {
+        return;
+    }
+    std::cout << std::setw(18) << std::left << label << histogram->count() << " round trips, p50 " << histogram->percentile(50.0)
+              << " us, p90 " << histogram->percentile(90.0) << " us, p99 " << histogram->percentile(99.0) << " us, max "
+              << histogram->max() << " us" << std::endl;
+}
+
+void print_result (const Result& result) {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(18) << std::left << "Link" << result.port << " at " << result.baud << " baud ("
+              << result.baud / 10 << " bytes/s on the wire)" << std::endl;
+    if (result.mode == "device") {
+        std::cout << std::setw(18) << std::left << "Samples" << result.samples_per_second << " /s" << std::endl;
+    }
+    std::cout << std::setw(18) << std::left << "Received" << result.bytes_received_per_second << " bytes/s" << std::endl;
+    std::cout << std::setw(18) << std::left << "Sent" << result.bytes_sent_per_second << " bytes/s" << std::endl;
+    if (result.mode == "device") {
+        std::cout << std::setw(18) << std::left << "Frames" << result.lost << " lost, " << result.corrupted << " corrupted" << std::endl;
+        print_percentiles("Read", result.read_rtt);
+        print_percentiles("Command", result.command_rtt);
+    } else {
+        std::cout << std::setw(18) << std::left << "Bytes" << result.lost << " not echoed, " << result.corrupted << " echoed wrong" << std::endl;
+        print_percentiles("Block", result.read_rtt);
+    }
+}
+
+// Appends the run to path, with a header if the file is new (or empty)
+bool append_result (const std::string& path, const Result& result) {
+    bool header;
+    {
+        std::ifstream existing(path);
+        header = !existing.is_open() || existing.peek() == std::ifstream::traits_type::eof();
+    }
+    std::ofstream file(path, std::ios::app);
+    if (!file.is_open()) {
+        std::cerr << "Error: could not open " << path << " for writing." << std::endl;
+        return false;
+    }
+    if (header) {
+        file << "time,mode,port,baud,seconds,samples_per_s,rx_bytes_per_s,tx_bytes_per_s,lost,corrupted,"
+                "rtt_count,rtt_p50_us,rtt_p99_us,rtt_max_us,command_count,command_p50_us,command_p99_us,command_max_us\n";
+    }
+    const std::time_t now = std::time(nullptr);
+    auto percentiles = [&](const Histogram* histogram) {
+        if (histogram) {
+            file << ',' << histogram->count() << ',' << histogram->percentile(50.0) << ',' << histogram->percentile(99.0) << ',' << histogram->max();
+        } else {
+            file << ",,,,";
+        }
+    };
+    file << std::put_time(std::localtime(&now), "%Y-%m-%dT%H:%M:%S") << ',' << result.mode << ',' << result.port << ',' << result.baud << ','
+         << result.seconds << ',' << result.samples_per_second << ',' << result.bytes_received_per_second << ','
+         << result.bytes_sent_per_second << ',' << result.lost << ',' << result.corrupted;
+    percentiles(result.read_rtt);
+    percentiles(result.command_rtt);
+    file << '\n';
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    SerialEngine engine;
+    Histogram block_rtt("loopback block round trip", "us");
+    Result result;
+    const bool ok = options.loopback.empty() ? bench_device(options, engine, result) : bench_loopback(options, block_rtt, result);
+    engine.close();
+    if (!ok) {
+        return 1;
+    }
+
+    print_result(result);
+    if (!options.output.empty() && !append_result(options.output, result)) {
+        return 1;
+    }
+    return 0;
+}
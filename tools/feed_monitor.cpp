@@ -0,0 +1,171 @@
+// Live Feed Monitor
+//   Demo consumer of the shared-memory sample feed (src/sample_feed.h): follows the samples published by main or
+//   headless from a separate process, without touching the serial port. Any number of monitors can run at once.
+//
+// Usage: feed_monitor [--feed <name>] [--interval <seconds>] [--csv <yes|no>] [--backlog <yes|no>]
+//   Prints, every interval (1 s by default), each source's sample rate, mean readings and angle, and how many
+//   samples this monitor lost because it fell a whole ring behind. --csv prints every sample to stdout instead (the
+//   summaries go to stderr), to pipe the live stream into a script. --backlog starts with the samples still in the
+//   ring instead of the newest one. Waits for a publisher, and for the next one once it goes away, until Ctrl-C.
+
+#include <chrono>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "sample_feed.h"
+#include "stats.h"
+
+const auto POLL_INTERVAL = std::chrono::milliseconds(5);
+const auto RECONNECT_INTERVAL = std::chrono::milliseconds(500);
+const size_t READ_BLOCK = 1024;
+
+struct Options {
+    std::string feed = DEFAULT_FEED_NAME;
+    double interval = 1.0;
+    bool csv = false;
+    bool backlog = false;
+};
+
+// What one source sent during the current interval
+struct SourceSummary {
+    RunningStats v;
+    RunningStats h;
+    int16_t angle = 0;
+};
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+void handle_signal (int) {
+    stop_requested = 1;
+}
+
+void print_usage () {
+    std::cerr << "Usage: feed_monitor [--feed <name>] [--interval <seconds>] [--csv <yes|no>] [--backlog <yes|no>]" << std::endl;
+}
+
+bool parse_options (int argc, char** argv, Options& options) {
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h") {
+                return false;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << flag << " needs a value." << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+            if (flag == "--feed") options.feed = value;
+            else if (flag == "--interval") options.interval = std::stod(value);
+            else if (flag == "--csv") options.csv = value != "no";
+            else if (flag == "--backlog") options.backlog = value != "no";
+            else {
+                std::cerr << "Error: unknown flag " << flag << std::endl;
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: invalid argument (" << e.what() << ")" << std::endl;
+        return false;
+    }
+    return options.interval > 0.0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    // Summaries go to stderr while the samples themselves are printed
+    std::ostream& report = options.csv ? std::cerr : std::cout;
+    if (options.csv) {
+        std::cout << "source,time_s,angle,vertical,horizontal,vertical_filtered,horizontal_filtered,raw_vertical,raw_horizontal\n";
+        std::cout << std::fixed << std::setprecision(6);
+    }
+
+    FeedReader reader;
+    FeedRecord records[READ_BLOCK];
+    std::map<uint16_t, SourceSummary> sources;
+    uint64_t reported_lost = 0;
+    auto last_report = std::chrono::steady_clock::now();
+    bool waiting_reported = false;
+
+    while (!stop_requested) {
+        if (!reader.is_open()) {
+            if (!reader.open(options.feed)) {
+                if (!waiting_reported) {
+                    report << "Waiting for a publisher on " << options.feed << "..." << std::endl;
+                    waiting_reported = true;
+                }
+                std::this_thread::sleep_for(RECONNECT_INTERVAL);
+                continue;
+            }
+            if (options.backlog) {
+                reader.rewind();
+            }
+            const FeedHeader& header = reader.get_header();
+            report << "Following " << options.feed << " (process " << header.publisher_pid << ", " << header.capacity
+                   << " records, base angle " << header.base_angle << ")" << std::endl;
+            waiting_reported = false;
+            reported_lost = 0;
+            last_report = std::chrono::steady_clock::now();
+        }
+
+        // Checked before reading, so whatever was published before the publisher closed is still read
+        const bool publisher_gone = reader.is_publisher_gone();
+        size_t count;
+        while ((count = reader.read(records, READ_BLOCK)) > 0) {
+            const int16_t base_angle = reader.get_header().base_angle;
+            for (size_t i = 0; i < count; i++) {
+                const FeedRecord& r = records[i];
+                SourceSummary& source = sources[r.source];
+                source.v.add(r.v);
+                source.h.add(r.h);
+                source.angle = static_cast<int16_t>(r.angle - base_angle);
+                if (options.csv) {
+                    std::cout << r.source << ',' << r.t << ',' << source.angle << ',' << r.v << ',' << r.h << ','
+                              << r.v_filtered << ',' << r.h_filtered << ',' << r.raw_v << ',' << r.raw_h << '\n';
+                }
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - last_report).count();
+        if (elapsed >= options.interval) {
+            for (auto& [id, source] : sources) {
+                report << "source " << id << ": " << std::fixed << std::setprecision(1)
+                       << source.v.get_count() / elapsed << " samples/s, angle " << source.angle
+                       << ", vertical " << std::setprecision(3) << source.v.get_mean() << " (sd " << source.v.get_stddev()
+                       << "), horizontal " << source.h.get_mean() << " (sd " << source.h.get_stddev() << ")"
+                       << std::defaultfloat << std::endl;
+                source.v.reset();
+                source.h.reset();
+            }
+            if (reader.get_lost() > reported_lost) {
+                report << "lost " << (reader.get_lost() - reported_lost) << " samples (fell a whole ring behind)" << std::endl;
+                reported_lost = reader.get_lost();
+            }
+            if (options.csv) {
+                std::cout.flush();
+            }
+            last_report = now;
+        }
+
+        if (publisher_gone) {
+            report << "The publisher closed " << options.feed << std::endl;
+            reader.close();
+            continue;
+        }
+        std::this_thread::sleep_for(POLL_INTERVAL);
+    }
+    return 0;
+}
@@ -0,0 +1,403 @@
+// Headless Wind Tunnel Capture
+//   Acquires from the Arduino and writes every sample to disk without any GUI (no SDL, OpenGL, ImGui or ImPlot),
+//   for long unattended runs on machines without a display.
+//
+// Usage: headless [--port <port|auto>] [--baud <baud>] [--max-baud <baud>] [--rate <samples/s>] [--duration <seconds>]
+//                 [--angles <angle>:<seconds>,...] [--config <path>] [--tare <yes|no>] [--output <file.csv|file.wtr>]
+//                 [--feed <name>] [--hold <force> | --profile <file.csv>] [--control <lift|drag>] [--gains <kp>,<ki>,<kd>]
+//   An output ending in .wtr is written as a binary recording (see src/recording.h), anything else as CSV.
+//   The calibration from --config is applied on the host. Unless --tare is no, both load cells are zeroed at the
+//   base angle before the run starts (like the sketch did on boot), replacing the configured offsets.
+//   --angles is a schedule of angles relative to BASE_ANGLE (like the dashboard slider), each held for the given time.
+//   Without --duration the run ends when the schedule does, or on Ctrl-C if there is no schedule.
+//   --port auto probes every USB serial port for the Arduino. Either way, if the link drops the run goes on and the
+//   Arduino is searched for again (see src/serial_engine.h); it gets the current angle and stream rate back once found.
+//   --max-baud is the fastest link rate negotiated once the Arduino is found (--baud: never faster); see
+//   src/serial_engine.h.
+//   --feed also publishes the samples to shared memory under that name, for live consumers (see src/sample_feed.h).
+//   --hold and --profile run the closed-loop force controller (see src/controller.h) instead of an angle schedule:
+//   --hold keeps the --control channel (lift by default) at a force, --profile traces a time_s,target CSV and ends the
+//   run with it (unless --duration is given). The sense-to-actuate latency is reported at the end.
+
+#include <chrono>
+#include <csignal>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "controller.h"
+#include "recording.h"
+#include "sample.h"
+#include "sample_feed.h"
+#include "serial_engine.h"
+#include "signal_stage.h"
+#include "spsc_ring.h"
+
+const size_t RING_CAPACITY = 1 << 16;
+const size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+const auto DRAIN_INTERVAL = std::chrono::milliseconds(10);
+// The servo gets this long to reach the base angle before the load cells are tared
+const auto TARE_SETTLE = std::chrono::seconds(1);
+const double TARE_TIMEOUT = 5.0;
+// Covers the UNO's startup after the port opens plus the baud rate negotiation
+const double CONNECT_TIMEOUT = 15.0;
+
+struct ScheduleStep {
+    int16_t angle_rel;
+    double seconds;
+};
+
+struct Options {
+    std::string port = DEFAULT_PORT;
+    unsigned long baud = BAUD;
+    unsigned long max_baud = MAX_BAUD;
+    int rate = 0;
+    double duration = 0.0;
+    std::vector<ScheduleStep> schedule;
+    std::string config = CONFIG_PATH;
+    bool tare = true;
+    std::string output;
+    std::string feed;
+    bool hold = false;
+    double hold_target = 0.0;
+    std::vector<ProfilePoint> profile;
+    ControllerSettings control;
+};
+
+static volatile std::sig_atomic_t stop_requested = 0;
+static std::unique_ptr<SpscRing<Sample>> sample_ring;
+static SerialEngine serial_engine;
+static SignalStage signal_stage;
+static FeedPublisher feed;
+static ForceController controller;
+static std::vector<Sample> acquired; // I/O thread only
+
+void handle_signal (int) {
+    stop_requested = 1;
+}
+
+void print_usage () {
+    std::cerr << "Usage: headless [--port <port|auto>] [--baud <baud>] [--max-baud <baud>] [--rate <samples/s>] [--duration <seconds>]" << std::endl
+              << "                [--angles <angle>:<seconds>,...] [--config <path>] [--tare <yes|no>] [--output <file.csv|file.wtr>]" << std::endl
+              << "                [--feed <name>] [--hold <force> | --profile <file.csv>] [--control <lift|drag>] [--gains <kp>,<ki>,<kd>]" << std::endl;
+}
+
+// Parses "0:10,5:10,-5:10" into schedule steps
+std::vector<ScheduleStep> parse_schedule (const std::string& text) {
+    std::vector<ScheduleStep> schedule;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string step = text.substr(start, end - start);
+        size_t split = step.find(':');
+        if (split == std::string::npos) {
+            throw std::invalid_argument("angle step \"" + step + "\" is not <angle>:<seconds>");
+        }
+        schedule.push_back({static_cast<int16_t>(std::stoi(step.substr(0, split))), std::stod(step.substr(split + 1))});
+        start = end + 1;
+    }
+    return schedule;
+}
+
+// Parses "0.1,0.5,0" into the controller's gains
+void parse_gains (const std::string& text, ControllerSettings& settings) {
+    size_t first = text.find(','), second = first == std::string::npos ? first : text.find(',', first + 1);
+    if (second == std::string::npos) {
+        throw std::invalid_argument("gains \"" + text + "\" are not <kp>,<ki>,<kd>");
+    }
+    settings.kp = std::stod(text.substr(0, first));
+    settings.ki = std::stod(text.substr(first + 1, second - first - 1));
+    settings.kd = std::stod(text.substr(second + 1));
+}
+
+bool parse_options (int argc, char** argv, Options& options) {
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h") {
+                return false;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << flag << " needs a value." << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+            if (flag == "--port") options.port = value;
+            else if (flag == "--baud") options.baud = std::stoul(value);
+            else if (flag == "--max-baud") options.max_baud = std::stoul(value);
+            else if (flag == "--rate") options.rate = std::stoi(value);
+            else if (flag == "--duration") options.duration = std::stod(value);
+            else if (flag == "--angles") options.schedule = parse_schedule(value);
+            else if (flag == "--config") options.config = value;
+            else if (flag == "--tare") options.tare = value != "no";
+            else if (flag == "--output") options.output = value;
+            else if (flag == "--feed") options.feed = value;
+            else if (flag == "--hold") {
+                options.hold = true;
+                options.hold_target = std::stod(value);
+            } else if (flag == "--profile") {
+                if (!load_profile(value, options.profile)) {
+                    return false;
+                }
+            } else if (flag == "--control") {
+                if (value != "lift" && value != "drag") {
+                    throw std::invalid_argument("--control is lift or drag");
+                }
+                options.control.channel = value == "lift" ? ControlChannel::Lift : ControlChannel::Drag;
+            }
+            else if (flag == "--gains") parse_gains(value, options.control);
+            else {
+                std::cerr << "Error: unknown flag " << flag << std::endl;
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: invalid argument (" << e.what() << ")" << std::endl;
+        return false;
+    }
+
+    if (options.output.empty()) {
+        char name[64];
+        std::time_t now = std::time(nullptr);
+        std::strftime(name, sizeof(name), "run_%Y%m%d_%H%M%S.csv", std::localtime(&now));
+        options.output = name;
+    }
+    if ((options.hold || !options.profile.empty()) && (!options.schedule.empty() || (options.hold && !options.profile.empty()))) {
+        std::cerr << "Error: --hold, --profile and --angles each drive the angle, use only one of them." << std::endl;
+        return false;
+    }
+    if (options.duration <= 0.0) {
+        for (const auto& step : options.schedule) {
+            options.duration += step.seconds;
+        }
+    }
+    return true;
+}
+
+// Frame handler, runs on the serial engine's I/O thread
+void handle_frame (const WtFrame& frame) {
+    Sample sample;
+    if (sample_from_frame(frame, serial_engine.get_clock(), host_time(), sample)) {
+        acquired.push_back(sample);
+    }
+}
+
+// Calibrates the samples of each read (see signal_stage.h), lets the force controller act on them, then hands them to
+//   the main thread (and the feed, if open)
+void handle_chunk () {
+    if (acquired.empty()) {
+        return;
+    }
+    signal_stage.process(acquired.data(), acquired.size());
+    controller.update(acquired.data(), acquired.size(), serial_engine);
+    for (const Sample& sample : acquired) {
+        sample_ring->push(sample);
+    }
+    feed.publish(acquired.data(), acquired.size(), 0);
+    acquired.clear();
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    Calibration calibration = base_calibration();
+    load_config(calibration, options.config);
+    signal_stage.set_calibration(calibration);
+
+    sample_ring = std::make_unique<SpscRing<Sample>>(RING_CAPACITY);
+    host_time(); // starts the sample clock
+
+    const bool binary = options.output.size() >= 4 && options.output.compare(options.output.size() - 4, 4, ".wtr") == 0;
+    Recorder recorder;
+    std::ofstream output;
+    std::vector<char> output_buffer(OUTPUT_BUFFER_SIZE);
+    if (!binary) {
+        output.rdbuf()->pubsetbuf(output_buffer.data(), output_buffer.size());
+        output.open(options.output);
+        if (!output) {
+            std::cerr << "Error: could not open " << options.output << " for writing." << std::endl;
+            return 1;
+        }
+        output << "time_s,angle,vertical,horizontal,raw_vertical,raw_horizontal\n";
+        output << std::fixed << std::setprecision(6); // microsecond timestamps, even hours into a run
+    }
+
+    if (!options.feed.empty() && !feed.open(options.feed, BASE_ANGLE)) {
+        return 1;
+    }
+
+    serial_engine.set_frame_handler(handle_frame);
+    serial_engine.set_chunk_handler(handle_chunk);
+    serial_engine.set_max_baud(options.max_baud);
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    if (options.port == "auto") {
+        std::cout << "Looking for the wind tunnel on every USB serial port..." << std::endl;
+        serial_engine.connect("", options.baud);
+    } else {
+        try {
+            if (!serial_engine.open(options.port, options.baud)) {
+                std::cerr << "Error: serial port " << options.port << " did not open." << std::endl;
+                return 1;
+            }
+        } catch (const serial::IOException& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    // Nothing is sent until the device has answered and the baud rate is settled, or the settle and tare timers
+    // would run while the UNO is still starting up
+    const double connect_start = host_time();
+    while (!(serial_engine.is_connected() && serial_engine.get_baud() != 0) && !stop_requested) {
+        if (options.port != "auto" && host_time() - connect_start > CONNECT_TIMEOUT) {
+            std::cerr << "Error: the wind tunnel did not answer on " << options.port << "." << std::endl;
+            serial_engine.close();
+            return 1;
+        }
+        std::this_thread::sleep_for(DRAIN_INTERVAL);
+    }
+    if (stop_requested) {
+        serial_engine.close();
+        return 1;
+    }
+    std::cout << "Serial port is open on port " + serial_engine.get_port() + ", and listening on baud rate of " + std::to_string(serial_engine.get_baud()) << std::endl;
+
+    // Starts streaming and zeroes the load cells at the base angle, then moves to the first angle of the schedule
+    serial_engine.send_angle(BASE_ANGLE);
+    serial_engine.start_stream(static_cast<uint16_t>(options.rate));
+    if (options.tare) {
+        std::this_thread::sleep_for(TARE_SETTLE);
+        signal_stage.tare(CHANNEL_V | CHANNEL_H);
+        static Sample discarded[4096];
+        const double tare_start = host_time();
+        while (signal_stage.is_taring() && !stop_requested && serial_engine.is_open() && host_time() - tare_start < TARE_TIMEOUT) {
+            sample_ring->pop(discarded, sizeof(discarded) / sizeof(discarded[0]));
+            std::this_thread::sleep_for(DRAIN_INTERVAL);
+        }
+        if (signal_stage.is_taring()) {
+            std::cerr << "Error: no samples arrived to tare the load cells." << std::endl;
+            serial_engine.close();
+            return 1;
+        }
+        sample_ring->pop(discarded, sizeof(discarded) / sizeof(discarded[0]));
+    }
+    size_t step = 0;
+    int16_t angle = BASE_ANGLE + (options.schedule.empty() ? 0 : options.schedule[0].angle_rel);
+    serial_engine.send_angle(angle);
+    controller.configure(options.control);
+    if (options.hold) {
+        controller.hold(options.hold_target, angle);
+    } else if (!options.profile.empty()) {
+        controller.trace(options.profile, angle);
+    }
+    const bool tracing = !options.profile.empty();
+
+    // The recording's header holds the calibration after taring
+    if (binary && !recorder.open(options.output, {serial_engine.get_port(), signal_stage.get_calibration(), BASE_ANGLE}, host_time())) {
+        serial_engine.close();
+        return 1;
+    }
+
+    const double start = host_time();
+    double step_start = start;
+    uint64_t samples_written = 0;
+    double last_report = start;
+
+    // Writes every sample received since the last call
+    static Sample drained[4096];
+    auto write_pending = [&]() {
+        size_t count;
+        while ((count = sample_ring->pop(drained, sizeof(drained) / sizeof(drained[0]))) > 0) {
+            for (size_t i = 0; i < count; i++) {
+                if (binary) {
+                    recorder.append(drained[i].t, drained[i].raw_v, drained[i].raw_h, drained[i].angle);
+                } else {
+                    output << drained[i].t - start << ',' << drained[i].angle << ',' << drained[i].v << ',' << drained[i].h << ','
+                           << drained[i].raw_v << ',' << drained[i].raw_h << '\n';
+                }
+            }
+            samples_written += count;
+        }
+    };
+
+    while (!stop_requested && serial_engine.is_open()) {
+        const double now = host_time();
+        if (options.duration > 0.0 && now - start >= options.duration) {
+            break;
+        }
+        if (tracing && options.duration <= 0.0 && !controller.is_active()) {
+            break; // the profile is done
+        }
+
+        // Advances the angle schedule
+        if (step < options.schedule.size() && now - step_start >= options.schedule[step].seconds) {
+            step_start = now;
+            if (++step < options.schedule.size()) {
+                angle = BASE_ANGLE + options.schedule[step].angle_rel;
+                serial_engine.send_angle(angle);
+            }
+        }
+
+        write_pending();
+        if (binary && !recorder.get_error().empty()) {
+            break; // the recorder already reported why
+        }
+
+        if (now - last_report >= 10.0) {
+            std::cout << samples_written << " samples written (" << sample_ring->overflows() << " overflowed, "
+                      << serial_engine.get_frames_corrupted() << " corrupted, " << serial_engine.get_frames_lost() << " lost, "
+                      << serial_engine.get_reconnects() << " reconnects, link " << link_state_name(serial_engine.get_link_state())
+                      << " at " << serial_engine.get_baud() << " baud)" << std::endl;
+            last_report = now;
+        }
+        std::this_thread::sleep_for(DRAIN_INTERVAL);
+    }
+
+    serial_engine.stop_stream();
+    std::this_thread::sleep_for(DRAIN_INTERVAL); // lets the I/O thread flush the stop command
+    serial_engine.close();
+    feed.close();
+
+    // Writes whatever arrived before the port closed
+    write_pending();
+    bool written = true;
+    if (binary) {
+        written = recorder.close();
+    } else {
+        output.flush();
+        if (!output) {
+            std::cerr << "Error: writing " << options.output << " failed." << std::endl;
+            written = false;
+        }
+    }
+
+    if (written) {
+        std::cout << "Wrote " << samples_written << " samples to " << options.output << std::endl;
+    }
+    if (options.hold || tracing) {
+        const ControllerStatus status = controller.get_status();
+        const Histogram& latency = serial_engine.get_control_latency();
+        std::cout << "Control: " << status.updates << " updates, " << status.stale << " stale samples skipped, "
+                  << latency.count() << " angles sent, sense to actuate median " << latency.percentile(50.0) << " us, 99% "
+                  << latency.percentile(99.0) << " us, max " << latency.max() << " us" << std::endl;
+    }
+    if (!written || !serial_engine.get_error().empty()) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,358 @@
+// Virtual Arduino Simulator
+//   Opens a pseudo-terminal and behaves like arduino/duo_sketch.ino on the other end of it, so main.cpp (or headless)
+//   can connect to the printed /dev/pts/N path like a real port. Commands are handled by the sketch's own firmware core
+//   (arduino/wt_core.h); only the servo and load cells are replaced by synthetic signals, and faults (garbage bytes,
+//   truncated frames, stalls) can be injected to stress the host.
+//   A pty has no line rate, so the UART is emulated: bytes leave at the baud rate the firmware core has set (10 bits
+//   per byte) through a 64 byte transmit buffer, like the UNO's, and arrive as garbage (both ways) while the host has
+//   its end of the pty set to another rate.
+//
+// Usage: simulator [--sample-rate <Hz>] [--noise <units>] [--drift <units/s>] [--latency <ms>]
+//                  [--garbage <probability>] [--truncate <probability>] [--stall-every <s>] [--stall-for <ms>]
+//                  [--max-baud <baud>] [--link <path>] [--seed <n>]
+//   --sample-rate is the simulated HX711 conversion rate (the real modules run at 10 or 80 Hz).
+//   --garbage/--truncate are per-frame probabilities. --link creates a symlink to the pty (e.g. /tmp/windtunnel).
+//   --max-baud is the fastest rate the simulated link carries cleanly: above it, bytes are corrupted both ways (like
+//   a cheap USB bridge or a long cable), to exercise the host's rate negotiation and fallback.
+//   Linux/macOS only (POSIX pseudo-terminals).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "wt_core.h" // the sketch's own protocol and command handling
+
+// Same default as the sketch
+const int BASE_ANGLE = 85;
+// Counts per unit of the simulated load cells, which scale --noise and --drift into raw counts
+const float BASE_CALIBRATION_V = 712.0f;
+const float BASE_CALIBRATION_H = 26.5f;
+
+// Synthetic balance: raw HX711 counts per degree away from BASE_ANGLE (lift ~ angle, drag ~ angle^2)
+const double LIFT_COUNTS_PER_DEGREE = 2500.0;
+const double DRAG_COUNTS_PER_DEGREE2 = 40.0;
+const double RAW_OFFSET_V = 84000.0;
+const double RAW_OFFSET_H = -12000.0;
+// Servo slew, so forces settle over a few hundred milliseconds like the real flap
+const double SERVO_DEGREES_PER_SECOND = 60.0;
+// Emulated UART: the UNO's transmit buffer, and the chance of a corrupted byte above --max-baud
+const size_t TX_BUFFER_SIZE = 64;
+const double BYTE_ERROR_RATE = 0.005;
+
+struct Options {
+    double sample_rate = 80.0;
+    double noise = 0.5;
+    double drift = 0.0;
+    double latency_ms = 0.0;
+    double garbage = 0.0;
+    double truncate = 0.0;
+    double stall_every = 0.0;
+    double stall_for_ms = 0.0;
+    unsigned long max_baud = 0; // 0: every rate is clean
+    std::string link;
+    unsigned seed = 0;
+};
+
+// A frame waiting for its simulated transmit latency to pass
+struct PendingWrite {
+    double due;
+    std::vector<uint8_t> bytes;
+};
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+void handle_signal (int) {
+    stop_requested = 1;
+}
+
+double now_seconds () {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+class Simulator {
+public:
+    Simulator(const Options& opts, int fd) : options(opts), master(fd), rng(opts.seed ? opts.seed : std::random_device{}()) {
+        WtCoreHooks hooks = {write_bytes, writable_bytes, set_angle, set_baud, this};
+        wt_core_init(&core, &hooks, BASE_ANGLE);
+    }
+
+    void run() {
+        double next_conversion = now_seconds();
+        double next_stall = options.stall_every > 0.0 ? now_seconds() + options.stall_every : -1.0;
+        uint8_t chunk[4096];
+
+        while (!stop_requested) {
+            double now = now_seconds();
+
+            // Stall: stops converting, reading and writing entirely, like a hung sketch
+            if (next_stall > 0.0 && now >= next_stall) {
+                std::cout << "Stalling for " << options.stall_for_ms << " ms" << std::endl;
+                usleep(static_cast<useconds_t>(options.stall_for_ms * 1000.0));
+                next_stall = now_seconds() + options.stall_every;
+                continue;
+            }
+
+            // New HX711 conversion
+            if (now >= next_conversion) {
+                convert(now);
+                next_conversion += 1.0 / options.sample_rate;
+                if (next_conversion < now) {
+                    next_conversion = now; // fell behind (e.g. after a stall), don't burst
+                }
+            }
+            wt_core_poll(&core, micros(now));
+
+            flush_due(now);
+
+            // Waits for host bytes until the next conversion or pending write
+            double wake = next_conversion;
+            if (!pending.empty() && pending.front().due < wake) {
+                wake = pending.front().due;
+            }
+            if (core.streaming && core.new_data && line_free_at > now && line_free_at < wake) {
+                wake = line_free_at; // a sample is waiting for room in the transmit buffer
+            }
+            int timeout_ms = static_cast<int>(std::max(0.0, (wake - now_seconds()) * 1000.0));
+            pollfd descriptor{master, POLLIN, 0};
+            int ready = poll(&descriptor, 1, timeout_ms);
+            if (ready > 0 && (descriptor.revents & POLLIN)) {
+                ssize_t count = read(master, chunk, sizeof(chunk));
+                const bool mismatched = host_baud() != baud;
+                for (ssize_t i = 0; i < count; i++) {
+                    wt_core_receive(&core, corrupt(chunk[i], mismatched), micros(now_seconds()));
+                }
+            } else if (ready > 0 && (descriptor.revents & POLLHUP)) {
+                usleep(10000); // no host attached to the pty yet
+            }
+        }
+    }
+
+private:
+    // Produces one conversion of both load cells (raw counts, like the HX711)
+    void convert(double now) {
+        double dt = now - last_conversion;
+        last_conversion = now;
+
+        // The servo slews towards its setpoint
+        double step = SERVO_DEGREES_PER_SECOND * dt;
+        double error = angle - servo_position;
+        servo_position += std::max(-step, std::min(step, error));
+
+        double relative = servo_position - BASE_ANGLE;
+        std::normal_distribution<double> noise(0.0, 1.0);
+        const double raw_v = RAW_OFFSET_V + LIFT_COUNTS_PER_DEGREE * relative + options.drift * BASE_CALIBRATION_V * now
+                           + options.noise * BASE_CALIBRATION_V * noise(rng);
+        const double raw_h = RAW_OFFSET_H + DRAG_COUNTS_PER_DEGREE2 * relative * relative + options.drift * BASE_CALIBRATION_H * now
+                           + options.noise * BASE_CALIBRATION_H * noise(rng);
+        wt_core_reading(&core, micros(now), static_cast<float>(raw_v), static_cast<float>(raw_h));
+    }
+
+    // micros() of the simulated board, which wraps like the real one
+    static uint32_t micros(double now) {
+        return static_cast<uint32_t>(static_cast<uint64_t>(now * 1e6));
+    }
+
+    // Hooks of the firmware core, in place of the sketch's servo and Serial calls
+    static void write_bytes(void* context, const uint8_t* data, uint16_t length) {
+        static_cast<Simulator*>(context)->send_bytes(data, length, now_seconds());
+    }
+
+    static void set_angle(void* context, int16_t value) {
+        static_cast<Simulator*>(context)->angle = value;
+    }
+
+    static uint16_t writable_bytes(void* context) {
+        Simulator* simulator = static_cast<Simulator*>(context);
+        const double queued = std::ceil((simulator->line_free_at - now_seconds()) * simulator->baud / 10.0);
+        return static_cast<uint16_t>(TX_BUFFER_SIZE - std::min<double>(TX_BUFFER_SIZE, std::max(0.0, queued)));
+    }
+
+    static void set_baud(void* context, uint32_t baud) {
+        Simulator* simulator = static_cast<Simulator*>(context);
+        simulator->line_free_at = std::max(simulator->line_free_at, now_seconds()); // like Serial.flush()
+        simulator->baud = baud;
+        std::cout << "Baud rate " << baud << std::endl;
+    }
+
+    // Rate the host has set on its end of the pty (the master shares the slave's termios), 0 if not a known one
+    uint32_t host_baud() const {
+        termios settings;
+        if (tcgetattr(master, &settings) != 0) {
+            return 0;
+        }
+        switch (cfgetospeed(&settings)) {
+            case B9600: return 9600;
+            case B19200: return 19200;
+            case B38400: return 38400;
+            case B57600: return 57600;
+            case B115200: return 115200;
+            case B230400: return 230400;
+            case B460800: return 460800;
+            case B500000: return 500000;
+            case B921600: return 921600;
+            case B1000000: return 1000000;
+            case B2000000: return 2000000;
+            default: return 0;
+        }
+    }
+
+    // A byte as it crosses the link: any byte if the two ends disagree on the rate, and above --max-baud some arrive
+    //   with a bit flipped
+    uint8_t corrupt(uint8_t byte, bool mismatched) {
+        if (mismatched) {
+            return static_cast<uint8_t>(std::uniform_int_distribution<int>(0, 255)(rng));
+        }
+        if (options.max_baud > 0 && baud > options.max_baud && std::uniform_real_distribution<double>(0.0, 1.0)(rng) < BYTE_ERROR_RATE) {
+            byte ^= static_cast<uint8_t>(1u << std::uniform_int_distribution<int>(0, 7)(rng));
+        }
+        return byte;
+    }
+
+    // Queues an encoded frame behind the simulated latency, injecting faults on the way
+    void send_bytes(const uint8_t* data, uint16_t size, double now) {
+        std::vector<uint8_t> bytes(data, data + size);
+        const bool mismatched = host_baud() != baud;
+        for (uint8_t& byte : bytes) {
+            byte = corrupt(byte, mismatched);
+        }
+
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+        if (chance(rng) < options.truncate) {
+            bytes.resize(std::uniform_int_distribution<size_t>(1, bytes.size() - 1)(rng));
+        }
+        if (chance(rng) < options.garbage) {
+            std::uniform_int_distribution<int> byte(0, 255);
+            size_t count = std::uniform_int_distribution<size_t>(1, 16)(rng);
+            for (size_t i = 0; i < count; i++) {
+                bytes.insert(bytes.begin(), static_cast<uint8_t>(byte(rng)));
+            }
+        }
+        // The frame is on the wire once the bytes ahead of it have been, and takes 10 bits per byte
+        line_free_at = std::max(line_free_at, now) + bytes.size() * 10.0 / baud;
+        pending.push_back({line_free_at + options.latency_ms / 1000.0, std::move(bytes)});
+        flush_due(now);
+    }
+
+    void flush_due(double now) {
+        while (!pending.empty() && pending.front().due <= now) {
+            const std::vector<uint8_t>& bytes = pending.front().bytes;
+            size_t written = 0;
+            while (written < bytes.size()) {
+                ssize_t count = write(master, bytes.data() + written, bytes.size() - written);
+                if (count <= 0) {
+                    break; // host not reading (or not attached): the data is dropped like on a real UART
+                }
+                written += static_cast<size_t>(count);
+            }
+            pending.pop_front();
+        }
+    }
+
+    Options options;
+    int master;
+    std::mt19937 rng;
+    WtCore core;
+    std::deque<PendingWrite> pending;
+    uint32_t baud = WT_BASE_BAUD;
+    double line_free_at = 0.0; // when the emulated UART has sent everything queued so far
+
+    int16_t angle = BASE_ANGLE;
+    double servo_position = BASE_ANGLE;
+    double last_conversion = 0.0;
+};
+
+void print_usage () {
+    std::cerr << "Usage: simulator [--sample-rate <Hz>] [--noise <units>] [--drift <units/s>] [--latency <ms>]" << std::endl
+              << "                 [--garbage <probability>] [--truncate <probability>] [--stall-every <s>] [--stall-for <ms>]" << std::endl
+              << "                 [--max-baud <baud>] [--link <path>] [--seed <n>]" << std::endl;
+}
+
+bool parse_options (int argc, char** argv, Options& options) {
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h" || i + 1 >= argc) {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (flag == "--sample-rate") options.sample_rate = std::stod(value);
+            else if (flag == "--noise") options.noise = std::stod(value);
+            else if (flag == "--drift") options.drift = std::stod(value);
+            else if (flag == "--latency") options.latency_ms = std::stod(value);
+            else if (flag == "--garbage") options.garbage = std::stod(value);
+            else if (flag == "--truncate") options.truncate = std::stod(value);
+            else if (flag == "--stall-every") options.stall_every = std::stod(value);
+            else if (flag == "--stall-for") options.stall_for_ms = std::stod(value);
+            else if (flag == "--max-baud") options.max_baud = std::stoul(value);
+            else if (flag == "--link") options.link = value;
+            else if (flag == "--seed") options.seed = static_cast<unsigned>(std::stoul(value));
+            else {
+                std::cerr << "Error: unknown flag " << flag << std::endl;
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: invalid argument (" << e.what() << ")" << std::endl;
+        return false;
+    }
+    return options.sample_rate > 0.0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        std::cerr << "Error: could not create a pseudo-terminal: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    // Raw mode, so protocol bytes (including 0x00 delimiters) pass through untouched
+    termios settings;
+    tcgetattr(master, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(master, TCSANOW, &settings);
+
+    std::string path = ptsname(master);
+    if (!options.link.empty()) {
+        unlink(options.link.c_str());
+        if (symlink(path.c_str(), options.link.c_str()) != 0) {
+            std::cerr << "Error: could not create the link " << options.link << ": " << std::strerror(errno) << std::endl;
+        } else {
+            path = options.link;
+        }
+    }
+    std::cout << "Simulated Arduino listening on " << path << " (" << options.sample_rate << " conversions per second)" << std::endl;
+
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    Simulator simulator(options, master);
+    simulator.run();
+
+    if (!options.link.empty()) {
+        unlink(options.link.c_str());
+    }
+    close(master);
+    return 0;
+}